@@ -0,0 +1,30 @@
+// chat.c
+#include "chat.h"
+
+#include <string.h>
+
+void chat_queue_name(char *queue_name, const char *name) {
+    snprintf(queue_name, QUEUE_NAME_SIZE, "/chat_%s", name);
+}
+
+Endpoint *chat_open(const char *name, int flags, size_t msg_size) {
+    char queue_name[QUEUE_NAME_SIZE];
+    chat_queue_name(queue_name, name);
+    return endpoint_open(queue_name, flags, msg_size, MAX_MSG);
+}
+
+void chat_control_name(char *queue_name, const char *server_name) {
+    snprintf(queue_name, QUEUE_NAME_SIZE, "/chat_%s.ctl", server_name);
+}
+
+Endpoint *chat_open_control(const char *server_name, int flags, size_t msg_size) {
+    char queue_name[QUEUE_NAME_SIZE];
+    chat_control_name(queue_name, server_name);
+    return endpoint_open(queue_name, flags, msg_size, MAX_MSG);
+}
+
+void send_message(Endpoint *queue, const char *message, unsigned int prio) {
+    if (endpoint_send(queue, message, strlen(message) + 1, prio) == -1) {
+        ERR("endpoint_send");
+    }
+}
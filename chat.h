@@ -0,0 +1,40 @@
+// chat.h
+// Stałe i pomocnicze funkcje wspólne dla programów czatu
+// (pipe4.c, pipe5.c, pipeServer.c, pipeClient.c).
+#ifndef CHAT_H
+#define CHAT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "transport.h"
+
+#define ERR(source) \
+    (fprintf(stderr, "%s:%d\n", __FILE__, __LINE__), perror(source), exit(EXIT_FAILURE))
+
+#define MSG_SIZE 256
+#define QUEUE_NAME_SIZE 64
+#define MAX_MSG 10
+
+#define MSG_CONNECT 0
+#define MSG_DISCONNECT 1
+#define MSG_TEXT 2
+// Ramka z historią pokoju, patrz history.h
+#define MSG_HISTORY 3
+
+// Wiadomość w formacie pipe4.c; pipe5.c przesyła same napisy "[nadawca] tekst"
+typedef struct {
+    char sender[QUEUE_NAME_SIZE];
+    char text[MSG_SIZE];
+} Message;
+
+// Nazwa kolejki serwera lub klienta: /chat_<name>
+void chat_queue_name(char *queue_name, const char *name);
+Endpoint *chat_open(const char *name, int flags, size_t msg_size);
+// Osobna kolejka serwera na MSG_CONNECT/MSG_DISCONNECT: /chat_<name>.ctl,
+// żeby łączenie się nie czekało za wiadomościami tekstowymi
+void chat_control_name(char *queue_name, const char *server_name);
+Endpoint *chat_open_control(const char *server_name, int flags, size_t msg_size);
+void send_message(Endpoint *queue, const char *message, unsigned int prio);
+
+#endif
@@ -0,0 +1,247 @@
+// history.c
+#include "history.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define HISTORY_MAGIC "SOPHST1\n"
+#define HISTORY_MAGIC_SIZE 8
+
+typedef struct {
+    double ts; // CLOCK_REALTIME, żeby wiek wpisów miał sens po restarcie
+    uint16_t len;
+    char data[HISTORY_ENTRY_SIZE];
+} HistoryEntry;
+
+// Układ pliku SOP_HISTORY i pamięci pierścienia
+typedef struct {
+    char magic[HISTORY_MAGIC_SIZE];
+    uint32_t size;
+    uint32_t capacity;
+    uint64_t seq; // ile wiadomości dopisano od początku
+    HistoryEntry entries[HISTORY_SIZE];
+} HistoryLog;
+
+struct HistoryRing {
+    HistoryLog *log;
+};
+
+static double history_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void shared_name(char *name, const char *server_name) {
+    snprintf(name, QUEUE_NAME_SIZE, "/chat_%s.hist", server_name);
+}
+
+// Zamyka fd niezależnie od wyniku
+static HistoryRing *history_map(int fd) {
+    HistoryRing *ring = malloc(sizeof(HistoryRing));
+    if (ring == NULL || ftruncate(fd, sizeof(HistoryLog)) == -1) {
+        goto fail;
+    }
+    ring->log = mmap(NULL, sizeof(HistoryLog), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring->log == MAP_FAILED) {
+        goto fail;
+    }
+    close(fd);
+
+    // Nowy plik albo zapisany przez inną wersję programu zaczynamy od nowa
+    HistoryLog *log = ring->log;
+    if (memcmp(log->magic, HISTORY_MAGIC, HISTORY_MAGIC_SIZE) != 0 || log->size != sizeof(HistoryLog) ||
+        log->capacity != HISTORY_SIZE) {
+        memset(log, 0, sizeof(HistoryLog));
+        memcpy(log->magic, HISTORY_MAGIC, HISTORY_MAGIC_SIZE);
+        log->size = sizeof(HistoryLog);
+        log->capacity = HISTORY_SIZE;
+    }
+    return ring;
+
+fail:;
+    int saved = errno;
+    close(fd);
+    free(ring);
+    errno = saved;
+    return NULL;
+}
+
+HistoryRing *history_open(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd == -1) {
+        return NULL;
+    }
+    return history_map(fd);
+}
+
+HistoryRing *history_open_shared(const char *server_name) {
+    char name[QUEUE_NAME_SIZE];
+    shared_name(name, server_name);
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd == -1) {
+        return NULL;
+    }
+    return history_map(fd);
+}
+
+int history_unlink(const char *server_name) {
+    char name[QUEUE_NAME_SIZE];
+    shared_name(name, server_name);
+    return shm_unlink(name);
+}
+
+HistoryRing *history_from_env(const char *server_name) {
+    const char *path = getenv("SOP_HISTORY");
+    if (path != NULL && *path == '\0') {
+        path = NULL;
+    }
+    HistoryRing *ring = path != NULL ? history_open(path) : history_open_shared(server_name);
+    if (ring == NULL) {
+        perror("history_open");
+        exit(EXIT_FAILURE);
+    }
+    if (path != NULL) {
+        printf("History in %s (%llu messages)\n", path, (unsigned long long)ring->log->seq);
+    }
+    return ring;
+}
+
+void history_close(HistoryRing *ring) {
+    if (ring == NULL) {
+        return;
+    }
+    msync(ring->log, sizeof(HistoryLog), MS_SYNC);
+    munmap(ring->log, sizeof(HistoryLog));
+    free(ring);
+}
+
+void history_append(HistoryRing *ring, const void *msg, size_t len) {
+    HistoryLog *log = ring->log;
+    HistoryEntry *entry = &log->entries[log->seq % HISTORY_SIZE];
+    if (len > HISTORY_ENTRY_SIZE) {
+        len = HISTORY_ENTRY_SIZE;
+    }
+    entry->ts = history_now();
+    entry->len = (uint16_t)len;
+    memcpy(entry->data, msg, len);
+    // Licznik na końcu: przerwany serwer zostawia najwyżej niedopisany wpis poza historią
+    __atomic_store_n(&log->seq, log->seq + 1, __ATOMIC_RELEASE);
+}
+
+void history_parse_request(const char *text, HistoryRequest *request) {
+    request->frame = 0;
+    request->count = HISTORY_COUNT;
+    request->seconds = 0;
+    if (strncmp(text, "history", strlen("history")) != 0) {
+        return;
+    }
+    const char *p = text + strlen("history");
+    while (*p != '\0') {
+        unsigned int value;
+        int n = 0;
+        if (sscanf(p, " frame=%u%n", &value, &n) == 1) {
+            request->frame = value < HISTORY_FRAME_SIZE ? value : HISTORY_FRAME_SIZE;
+        } else if (sscanf(p, " count=%u%n", &value, &n) == 1) {
+            request->count = value;
+        } else if (sscanf(p, " seconds=%u%n", &value, &n) == 1) {
+            request->seconds = value;
+        }
+        if (n == 0) {
+            break; // nieznane pole - reszta zostaje domyślna
+        }
+        p += n;
+    }
+}
+
+void history_format_request(char *text, size_t size, const HistoryRequest *request) {
+    snprintf(text, size, "history frame=%u count=%u seconds=%u", request->frame, request->count,
+             request->seconds);
+}
+
+void history_seek(HistoryRing *ring, HistoryCursor *cursor, const HistoryRequest *request) {
+    HistoryLog *log = ring->log;
+    uint64_t first = log->seq > HISTORY_SIZE ? log->seq - HISTORY_SIZE : 0;
+    if (log->seq - first > request->count) {
+        first = log->seq - request->count;
+    }
+    if (request->seconds > 0) {
+        double oldest = history_now() - request->seconds;
+        while (first < log->seq && log->entries[first % HISTORY_SIZE].ts < oldest) {
+            first++;
+        }
+    }
+    cursor->next = first;
+    cursor->end = log->seq;
+    cursor->frame = request->frame;
+}
+
+int history_pending(const HistoryCursor *cursor) {
+    return cursor->next < cursor->end;
+}
+
+size_t history_frame(HistoryRing *ring, HistoryCursor *cursor, void *frame, unsigned int *entries) {
+    HistoryLog *log = ring->log;
+    if (cursor->end > log->seq) {
+        // Kursor z poprzedniego procesu, a historia była tylko w jego pamięci
+        cursor->next = cursor->end = log->seq;
+    }
+    // Wpisy nadpisane, zanim klient je dostał, przepadają
+    if (log->seq > HISTORY_SIZE && cursor->next < log->seq - HISTORY_SIZE) {
+        cursor->next = log->seq - HISTORY_SIZE;
+    }
+    *entries = 0;
+    if (!history_pending(cursor)) {
+        return 0;
+    }
+
+    if (cursor->frame == 0) {
+        const HistoryEntry *entry = &log->entries[cursor->next % HISTORY_SIZE];
+        memcpy(frame, entry->data, entry->len);
+        *entries = 1;
+        return entry->len;
+    }
+
+    size_t len = 0;
+    for (uint64_t seq = cursor->next; seq < cursor->end; seq++) {
+        const HistoryEntry *entry = &log->entries[seq % HISTORY_SIZE];
+        if (len + sizeof(uint16_t) + entry->len > cursor->frame) {
+            break;
+        }
+        memcpy((char *)frame + len, &entry->len, sizeof(uint16_t));
+        memcpy((char *)frame + len + sizeof(uint16_t), entry->data, entry->len);
+        len += sizeof(uint16_t) + entry->len;
+        (*entries)++;
+    }
+    if (*entries == 0) {
+        // Ramka mniejsza niż wiadomość - tej klient nie dostanie
+        cursor->next++;
+        return history_frame(ring, cursor, frame, entries);
+    }
+    return len;
+}
+
+void history_advance(HistoryCursor *cursor, unsigned int entries) {
+    cursor->next += entries;
+}
+
+const void *history_unpack(const void *frame, size_t len, size_t *offset, size_t *msg_len) {
+    uint16_t n;
+    if (*offset + sizeof(uint16_t) > len) {
+        return NULL;
+    }
+    memcpy(&n, (const char *)frame + *offset, sizeof(uint16_t));
+    if (*offset + sizeof(uint16_t) + n > len) {
+        return NULL;
+    }
+    const void *msg = (const char *)frame + *offset + sizeof(uint16_t);
+    *offset += sizeof(uint16_t) + n;
+    *msg_len = n;
+    return msg;
+}
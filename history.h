@@ -0,0 +1,80 @@
+// history.h
+// Historia pokoju czatu: ostatnie HISTORY_SIZE rozesłanych wiadomości, żeby
+// klient, który dołączył później, zobaczył, o czym była mowa.
+//
+// Pierścień trzymamy w pamięci dzielonej /chat_<serwer>.hist, która przeżywa
+// restart serwera (exec), a znika razem z nim (history_unlink). Gdy ustawiono
+// SOP_HISTORY=<plik>, pierścień jest w pliku zmapowanym przez mmap i przeżywa
+// także zatrzymanie serwera. Jeden plik na jeden serwer.
+//
+// Nowy klient może w MSG_CONNECT, po swojej nazwie, poprosić o historię
+// napisem "history frame=<bajty> count=<n> seconds=<t>" (każde pole
+// opcjonalne). Dostaje ostatnie count wiadomości, ale nie starsze niż
+// seconds. Klient, który podał frame, dostaje je spakowane w ramki MSG_HISTORY
+// o długości do frame bajtów: kolejno uint16_t długość + treść wiadomości.
+// Pozostali dostają je po jednej jako zwykłe MSG_TEXT.
+//
+// Serwer wysyła co najwyżej HISTORY_FRAMES_PER_ROUND ramek na klienta naraz,
+// resztę w kolejnych rundach, żeby historia nie zajęła kolejki klienta
+// potrzebnej bieżącym wiadomościom.
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chat.h"
+
+#define HISTORY_SIZE 256
+#define HISTORY_ENTRY_SIZE (QUEUE_NAME_SIZE + MSG_SIZE)
+#define HISTORY_FRAME_SIZE 4096
+#define HISTORY_FRAMES_PER_ROUND 2
+// Co ile sekund serwer wraca do niedokończonej historii
+#define HISTORY_INTERVAL 0.01
+
+// Bez prośby klienta: tyle ostatnich wiadomości, bez limitu wieku
+#define HISTORY_COUNT 20
+
+typedef struct {
+    unsigned int frame;   // maksymalna długość ramki, 0 = po jednej wiadomości
+    unsigned int count;   // ile ostatnich wiadomości
+    unsigned int seconds; // nie starsze niż, 0 = bez limitu
+} HistoryRequest;
+
+// Pozycja klienta w historii: wysyła się [next, end), end to chwila dołączenia
+typedef struct {
+    uint64_t next;
+    uint64_t end;
+    unsigned int frame;
+} HistoryCursor;
+
+typedef struct HistoryRing HistoryRing;
+
+// Historia w pamięci dzielonej serwera, gdy SOP_HISTORY nie jest ustawione
+HistoryRing *history_from_env(const char *server_name);
+HistoryRing *history_open(const char *path);
+HistoryRing *history_open_shared(const char *server_name);
+void history_close(HistoryRing *ring);
+// Usuwa pamięć dzieloną historii; plik SOP_HISTORY zostaje
+int history_unlink(const char *server_name);
+
+void history_append(HistoryRing *ring, const void *msg, size_t len);
+
+// Napis prośby (może być pusty) na HistoryRequest, frame przycięte do HISTORY_FRAME_SIZE
+void history_parse_request(const char *text, HistoryRequest *request);
+void history_format_request(char *text, size_t size, const HistoryRequest *request);
+
+// Ustawia kursor nowego klienta zgodnie z prośbą
+void history_seek(HistoryRing *ring, HistoryCursor *cursor, const HistoryRequest *request);
+int history_pending(const HistoryCursor *cursor);
+// Kolejna ramka dla klienta (HISTORY_FRAME_SIZE bajtów bufora): przy
+// cursor->frame == 0 sama treść jednej wiadomości. Zwraca długość, 0 gdy
+// nie ma czego wysłać. Kursor przesuwa dopiero history_advance, po udanym
+// wysłaniu, o *entries wiadomości.
+size_t history_frame(HistoryRing *ring, HistoryCursor *cursor, void *frame, unsigned int *entries);
+void history_advance(HistoryCursor *cursor, unsigned int entries);
+
+// Po stronie klienta: kolejna wiadomość z ramki MSG_HISTORY albo NULL
+const void *history_unpack(const void *frame, size_t len, size_t *offset, size_t *msg_len);
+
+#endif
@@ -0,0 +1,687 @@
+// ipcbench.c
+// Mikrobenchmark mechanizmów IPC używanych w tym repozytorium:
+// pipe (sop.c), kolejki POSIX z mq_receive (pipeServer.c, zad2.c),
+// z SIGEV_SIGNAL (pipeginalnot.c) i SIGEV_THREAD (pipe4.c), oraz
+// eventfd, socketpair(AF_UNIX, SOCK_DGRAM) i pierścień w pamięci dzielonej.
+//
+// Tryby:
+//   latency    - opóźnienie w jedną stronę (znacznik czasu w wiadomości),
+//                producent wysyła co <gap> us
+//   pingpong   - czas obiegu (RTT) wiadomość tam i z powrotem, 1 na 1
+//   throughput - przepustowość, <p> producentów i <c> konsumentów naraz
+//
+// Wyniki w CSV na stdout (jeden wiersz na konfigurację), komunikaty na stderr.
+//
+// Kompilacja: gcc -O2 -o ipcbench ipcbench.c -lrt -lpthread
+// Przykład:   ./ipcbench -t pipe,mq,shm -m throughput -s 64,1024 -p 1,4 -c 1,2 > wyniki.csv
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <mqueue.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define MAX_SIZE 8192
+#define MAX_PROCS 64
+#define MAX_LIST 16
+#define QUEUE_NAME_SIZE 64
+#define MQ_MAX_MSG 10
+#define RING_SLOTS 64
+#define NOTIFY_SIGNAL SIGUSR1
+
+#define ROLE_SEND 0
+#define ROLE_RECV 1
+
+#define ERR(source) \
+    (fprintf(stderr, "%s:%d\n", __FILE__, __LINE__), perror(source), exit(EXIT_FAILURE))
+
+// Nagłówek na początku każdej wiadomości
+typedef struct {
+    uint64_t ts;
+} MsgHeader;
+
+// Pierścień w pamięci dzielonej, chroniony muteksem współdzielonym między procesami
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    unsigned head;
+    unsigned tail;
+    unsigned count;
+    unsigned slot_size;
+    char data[];
+} Ring;
+
+typedef struct Channel Channel;
+
+typedef struct {
+    const char *name;
+    int max_size;        // największa wiadomość przesyłana atomowo
+    int signal_only;     // eventfd: przenosi tylko licznik, bez treści
+    int single_consumer; // mq_notify obsługuje tylko jednego odbiorcę
+    void (*create)(Channel *ch, int size);
+    void (*attach)(Channel *ch, int role);
+    void (*send)(Channel *ch, const void *buf, int size);
+    void (*recv)(Channel *ch, void *buf, int size);
+    void (*destroy)(Channel *ch);
+} Transport;
+
+struct Channel {
+    const Transport *tp;
+    int fd[2];
+    mqd_t mq;
+    char mq_name[QUEUE_NAME_SIZE];
+    int size;
+    Ring *ring;
+    size_t ring_len;
+};
+
+// Wyniki zapisywane przez procesy potomne w pamięci dzielonej
+typedef struct {
+    uint64_t finish[MAX_PROCS];
+    uint64_t lat[];
+} Shared;
+
+static int channel_seq = 0;
+static sem_t notify_sem;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void write_all(int fd, const void *buf, int size) {
+    if (write(fd, buf, size) != size) {
+        ERR("write");
+    }
+}
+
+static void read_all(int fd, void *buf, int size) {
+    if (read(fd, buf, size) != size) {
+        ERR("read");
+    }
+}
+
+// ---- pipe ----
+
+static void pipe_create(Channel *ch, int size) {
+    if (pipe(ch->fd) == -1) {
+        ERR("pipe");
+    }
+}
+
+static void fd_attach(Channel *ch, int role) {
+}
+
+static void pipe_send(Channel *ch, const void *buf, int size) {
+    write_all(ch->fd[1], buf, size);
+}
+
+static void pipe_recv(Channel *ch, void *buf, int size) {
+    read_all(ch->fd[0], buf, size);
+}
+
+static void fd_destroy(Channel *ch) {
+    close(ch->fd[0]);
+    close(ch->fd[1]);
+}
+
+// ---- socketpair ----
+
+static void sock_create(Channel *ch, int size) {
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, ch->fd) == -1) {
+        ERR("socketpair");
+    }
+}
+
+static void sock_send(Channel *ch, const void *buf, int size) {
+    if (send(ch->fd[1], buf, size, 0) != size) {
+        ERR("send");
+    }
+}
+
+static void sock_recv(Channel *ch, void *buf, int size) {
+    if (recv(ch->fd[0], buf, size, 0) != size) {
+        ERR("recv");
+    }
+}
+
+// ---- eventfd ----
+
+static void efd_create(Channel *ch, int size) {
+    ch->fd[0] = eventfd(0, EFD_SEMAPHORE);
+    if (ch->fd[0] == -1) {
+        ERR("eventfd");
+    }
+    ch->fd[1] = dup(ch->fd[0]);
+}
+
+static void efd_send(Channel *ch, const void *buf, int size) {
+    uint64_t one = 1;
+    write_all(ch->fd[1], &one, sizeof(one));
+}
+
+static void efd_recv(Channel *ch, void *buf, int size) {
+    uint64_t value;
+    read_all(ch->fd[0], &value, sizeof(value));
+}
+
+// ---- kolejki POSIX ----
+
+static void mq_create(Channel *ch, int size) {
+    snprintf(ch->mq_name, QUEUE_NAME_SIZE, "/ipcbench_%d_%d", getpid(), channel_seq++);
+    struct mq_attr attr = {0, MQ_MAX_MSG, size, 0};
+    ch->mq = mq_open(ch->mq_name, O_RDWR | O_CREAT | O_EXCL, 0600, &attr);
+    if (ch->mq == (mqd_t)-1) {
+        ERR("mq_open");
+    }
+}
+
+// Każdy proces otwiera kolejkę od nowa: deskryptory po fork() dzielą flagi,
+// a odbiorcy z powiadomieniami potrzebują O_NONBLOCK tylko dla siebie
+static void mq_attach_flags(Channel *ch, int role, int recv_flags) {
+    mq_close(ch->mq);
+    ch->mq = mq_open(ch->mq_name, role == ROLE_SEND ? O_WRONLY : O_RDONLY | recv_flags);
+    if (ch->mq == (mqd_t)-1) {
+        ERR("mq_open");
+    }
+}
+
+static void mq_attach(Channel *ch, int role) {
+    mq_attach_flags(ch, role, 0);
+}
+
+static void mq_send_msg(Channel *ch, const void *buf, int size) {
+    if (mq_send(ch->mq, buf, size, 0) == -1) {
+        ERR("mq_send");
+    }
+}
+
+static void mq_recv_msg(Channel *ch, void *buf, int size) {
+    if (mq_receive(ch->mq, buf, MAX_SIZE, NULL) == -1) {
+        ERR("mq_receive");
+    }
+}
+
+static void mq_destroy(Channel *ch) {
+    mq_close(ch->mq);
+    mq_unlink(ch->mq_name);
+}
+
+// Wariant z pipeginalnot.c: mq_notify + SIGEV_SIGNAL, sygnał odbierany sigwaitinfo()
+static void mq_signal_attach(Channel *ch, int role) {
+    mq_attach_flags(ch, role, O_NONBLOCK);
+    if (role == ROLE_RECV) {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, NOTIFY_SIGNAL);
+        sigprocmask(SIG_BLOCK, &mask, NULL);
+    }
+}
+
+// mq_notify działa tylko przy przejściu pusta -> niepusta, więc po rejestracji
+// trzeba jeszcze raz sprawdzić kolejkę. EBUSY oznacza, że rejestracja z
+// poprzedniego obiegu wciąż czeka.
+static int mq_arm(Channel *ch, struct sigevent *sev, void *buf) {
+    if (mq_notify(ch->mq, sev) == -1 && errno != EBUSY) {
+        ERR("mq_notify");
+    }
+    if (mq_receive(ch->mq, buf, MAX_SIZE, NULL) != -1) {
+        return 1;
+    }
+    if (errno != EAGAIN) {
+        ERR("mq_receive");
+    }
+    return 0;
+}
+
+static void mq_signal_recv(Channel *ch, void *buf, int size) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, NOTIFY_SIGNAL);
+
+    while (1) {
+        if (mq_receive(ch->mq, buf, MAX_SIZE, NULL) != -1) {
+            return;
+        }
+        if (errno != EAGAIN) {
+            ERR("mq_receive");
+        }
+        struct sigevent sev = {};
+        sev.sigev_notify = SIGEV_SIGNAL;
+        sev.sigev_signo = NOTIFY_SIGNAL;
+        if (mq_arm(ch, &sev, buf)) {
+            return;
+        }
+        sigwaitinfo(&mask, NULL);
+    }
+}
+
+// Wariant z pipe4.c: mq_notify + SIGEV_THREAD, wątek budzi odbiorcę semaforem
+static void notify_thread(union sigval sv) {
+    sem_post(&notify_sem);
+}
+
+static void mq_thread_attach(Channel *ch, int role) {
+    mq_attach_flags(ch, role, O_NONBLOCK);
+    if (role == ROLE_RECV && sem_init(&notify_sem, 0, 0) == -1) {
+        ERR("sem_init");
+    }
+}
+
+static void mq_thread_recv(Channel *ch, void *buf, int size) {
+    while (1) {
+        if (mq_receive(ch->mq, buf, MAX_SIZE, NULL) != -1) {
+            return;
+        }
+        if (errno != EAGAIN) {
+            ERR("mq_receive");
+        }
+        struct sigevent sev = {};
+        sev.sigev_notify = SIGEV_THREAD;
+        sev.sigev_notify_function = notify_thread;
+        if (mq_arm(ch, &sev, buf)) {
+            return;
+        }
+        while (sem_wait(&notify_sem) == -1 && errno == EINTR) {
+        }
+    }
+}
+
+// ---- pierścień w pamięci dzielonej ----
+
+static void shm_create(Channel *ch, int size) {
+    ch->ring_len = sizeof(Ring) + (size_t)RING_SLOTS * size;
+    ch->ring = mmap(NULL, ch->ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (ch->ring == MAP_FAILED) {
+        ERR("mmap");
+    }
+    Ring *r = ch->ring;
+    pthread_mutexattr_t ma;
+    pthread_mutexattr_init(&ma);
+    pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&r->lock, &ma);
+    pthread_mutexattr_destroy(&ma);
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&r->not_empty, &ca);
+    pthread_cond_init(&r->not_full, &ca);
+    pthread_condattr_destroy(&ca);
+
+    r->slot_size = size;
+}
+
+static void shm_send(Channel *ch, const void *buf, int size) {
+    Ring *r = ch->ring;
+    pthread_mutex_lock(&r->lock);
+    while (r->count == RING_SLOTS) {
+        pthread_cond_wait(&r->not_full, &r->lock);
+    }
+    memcpy(r->data + (size_t)r->tail * r->slot_size, buf, size);
+    r->tail = (r->tail + 1) % RING_SLOTS;
+    r->count++;
+    pthread_cond_signal(&r->not_empty);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void shm_recv(Channel *ch, void *buf, int size) {
+    Ring *r = ch->ring;
+    pthread_mutex_lock(&r->lock);
+    while (r->count == 0) {
+        pthread_cond_wait(&r->not_empty, &r->lock);
+    }
+    memcpy(buf, r->data + (size_t)r->head * r->slot_size, size);
+    r->head = (r->head + 1) % RING_SLOTS;
+    r->count--;
+    pthread_cond_signal(&r->not_full);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void shm_destroy(Channel *ch) {
+    munmap(ch->ring, ch->ring_len);
+}
+
+static const Transport transports[] = {
+    {"pipe", PIPE_BUF, 0, 0, pipe_create, fd_attach, pipe_send, pipe_recv, fd_destroy},
+    {"mq", MAX_SIZE, 0, 0, mq_create, mq_attach, mq_send_msg, mq_recv_msg, mq_destroy},
+    {"mq_signal", MAX_SIZE, 0, 1, mq_create, mq_signal_attach, mq_send_msg, mq_signal_recv, mq_destroy},
+    {"mq_thread", MAX_SIZE, 0, 1, mq_create, mq_thread_attach, mq_send_msg, mq_thread_recv, mq_destroy},
+    {"eventfd", sizeof(uint64_t), 1, 0, efd_create, fd_attach, efd_send, efd_recv, fd_destroy},
+    {"socketpair", MAX_SIZE, 0, 0, sock_create, fd_attach, sock_send, sock_recv, fd_destroy},
+    {"shm", MAX_SIZE, 0, 0, shm_create, fd_attach, shm_send, shm_recv, shm_destroy},
+};
+#define TRANSPORT_COUNT ((int)(sizeof(transports) / sizeof(transports[0])))
+
+// ---- przebieg pomiaru ----
+
+typedef struct {
+    const char *mode;
+    int size;
+    int producers;
+    int consumers;
+    int messages;
+    int gap_us;
+} Config;
+
+static void wait_for_start(int go_fd) {
+    char c;
+    read(go_fd, &c, 1); // EOF, gdy rodzic zamknie potok startowy
+}
+
+static void producer(const Config *cfg, Channel *fwd, Channel *back, Shared *sh, int id, int go_fd) {
+    char buf[MAX_SIZE] = {0};
+    MsgHeader *hdr = (MsgHeader *)buf;
+    int pingpong = strcmp(cfg->mode, "pingpong") == 0;
+    int count = cfg->messages / cfg->producers;
+
+    fwd->tp->attach(fwd, ROLE_SEND);
+    if (pingpong) {
+        back->tp->attach(back, ROLE_RECV);
+    }
+    wait_for_start(go_fd);
+
+    for (int i = 0; i < count; i++) {
+        uint64_t start = now_ns();
+        hdr->ts = start;
+        fwd->tp->send(fwd, buf, cfg->size);
+        if (pingpong) {
+            back->tp->recv(back, buf, cfg->size);
+            sh->lat[i] = now_ns() - start;
+        } else if (cfg->gap_us > 0 && strcmp(cfg->mode, "latency") == 0) {
+            usleep(cfg->gap_us);
+        }
+    }
+    sh->finish[id] = now_ns();
+    _exit(EXIT_SUCCESS);
+}
+
+static void consumer(const Config *cfg, Channel *fwd, Channel *back, Shared *sh, int id, int go_fd) {
+    char buf[MAX_SIZE];
+    MsgHeader *hdr = (MsgHeader *)buf;
+    int pingpong = strcmp(cfg->mode, "pingpong") == 0;
+    int count = cfg->messages / cfg->consumers;
+    uint64_t *lat = sh->lat + (size_t)id * count;
+
+    fwd->tp->attach(fwd, ROLE_RECV);
+    if (pingpong) {
+        back->tp->attach(back, ROLE_SEND);
+    }
+    wait_for_start(go_fd);
+
+    for (int i = 0; i < count; i++) {
+        fwd->tp->recv(fwd, buf, cfg->size);
+        if (pingpong) {
+            back->tp->send(back, buf, cfg->size);
+        } else if (!fwd->tp->signal_only) {
+            lat[i] = now_ns() - hdr->ts;
+        }
+    }
+    sh->finish[cfg->producers + id] = now_ns();
+    _exit(EXIT_SUCCESS);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run(const Transport *tp, const Config *cfg) {
+    int pingpong = strcmp(cfg->mode, "pingpong") == 0;
+    size_t shared_len = sizeof(Shared) + (size_t)cfg->messages * sizeof(uint64_t);
+    Shared *sh = mmap(NULL, shared_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED) {
+        ERR("mmap");
+    }
+
+    Channel fwd = {.tp = tp, .size = cfg->size}, back = {.tp = tp, .size = cfg->size};
+    tp->create(&fwd, cfg->size);
+    if (pingpong) {
+        tp->create(&back, cfg->size);
+    }
+
+    int go[2];
+    if (pipe(go) == -1) {
+        ERR("pipe");
+    }
+
+    int procs = cfg->producers + cfg->consumers;
+    pid_t pids[MAX_PROCS];
+    for (int i = 0; i < procs; i++) {
+        if ((pids[i] = fork()) == -1) {
+            ERR("fork");
+        }
+        if (pids[i] == 0) {
+            close(go[1]);
+            if (i < cfg->producers) {
+                producer(cfg, &fwd, &back, sh, i, go[0]);
+            } else {
+                consumer(cfg, &fwd, &back, sh, i - cfg->producers, go[0]);
+            }
+        }
+    }
+
+    close(go[0]);
+    usleep(50 * 1000); // niech wszyscy dojdą do bariery
+    uint64_t start = now_ns();
+    close(go[1]);
+
+    int failed = 0;
+    for (int i = 0; i < procs; i++) {
+        int status;
+        waitpid(pids[i], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            failed = 1;
+        }
+    }
+
+    tp->destroy(&fwd);
+    if (pingpong) {
+        tp->destroy(&back);
+    }
+
+    if (failed) {
+        fprintf(stderr, "%s/%s size=%d: child process failed\n", tp->name, cfg->mode, cfg->size);
+        munmap(sh, shared_len);
+        return;
+    }
+
+    uint64_t end = 0;
+    for (int i = 0; i < procs; i++) {
+        if (sh->finish[i] > end) {
+            end = sh->finish[i];
+        }
+    }
+    double elapsed = (double)(end - start);
+    double msg_per_s = cfg->messages / (elapsed / 1e9);
+    double mib_per_s = msg_per_s * cfg->size / (1024.0 * 1024.0);
+
+    printf("%s,%s,%d,%d,%d,%d,%.0f,%.0f,%.2f", tp->name, cfg->mode, cfg->size, cfg->producers,
+           cfg->consumers, cfg->messages, elapsed, msg_per_s, mib_per_s);
+    if (tp->signal_only && !pingpong) {
+        printf(",,,,\n");
+    } else {
+        int n = cfg->messages;
+        qsort(sh->lat, n, sizeof(uint64_t), cmp_u64);
+        double sum = 0;
+        for (int i = 0; i < n; i++) {
+            sum += sh->lat[i];
+        }
+        printf(",%.0f,%llu,%llu,%llu\n", sum / n, (unsigned long long)sh->lat[n / 2],
+               (unsigned long long)sh->lat[(size_t)n * 99 / 100], (unsigned long long)sh->lat[n - 1]);
+    }
+    fflush(stdout);
+    munmap(sh, shared_len);
+}
+
+// ---- argumenty ----
+
+static int parse_list(char *arg, const char *items[], int max) {
+    int n = 0;
+    for (char *tok = strtok(arg, ","); tok != NULL && n < max; tok = strtok(NULL, ",")) {
+        items[n++] = tok;
+    }
+    return n;
+}
+
+static int parse_int_list(char *arg, int items[], int max) {
+    const char *tmp[MAX_LIST];
+    int n = parse_list(arg, tmp, max < MAX_LIST ? max : MAX_LIST);
+    for (int i = 0; i < n; i++) {
+        items[i] = atoi(tmp[i]);
+    }
+    return n;
+}
+
+static const Transport *find_transport(const char *name) {
+    for (int i = 0; i < TRANSPORT_COUNT; i++) {
+        if (strcmp(transports[i].name, name) == 0) {
+            return &transports[i];
+        }
+    }
+    return NULL;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-t transports] [-m modes] [-s sizes] [-p producers] [-c consumers] [-n messages] [-g gap_us]\n"
+            "  transports: pipe,mq,mq_signal,mq_thread,eventfd,socketpair,shm (default: all)\n"
+            "  modes:      latency,pingpong,throughput (default: all)\n"
+            "  sizes, producers, consumers: comma separated lists\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const Transport *tps[MAX_LIST];
+    int tp_count = 0;
+    const char *modes[MAX_LIST] = {"latency", "pingpong", "throughput"};
+    int mode_count = 3;
+    int sizes[MAX_LIST] = {16, 256, 4096};
+    int size_count = 3;
+    int prods[MAX_LIST] = {1}, prod_count = 1;
+    int cons[MAX_LIST] = {1}, cons_count = 1;
+    int messages = 10000;
+    int gap_us = 100;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:m:s:p:c:n:g:")) != -1) {
+        switch (opt) {
+        case 't': {
+            const char *names[MAX_LIST];
+            int n = parse_list(optarg, names, MAX_LIST);
+            for (int i = 0; i < n; i++) {
+                if (tp_count == MAX_LIST) {
+                    fprintf(stderr, "Too many transports, at most %d\n", MAX_LIST);
+                    usage(argv[0]);
+                }
+                if ((tps[tp_count] = find_transport(names[i])) == NULL) {
+                    fprintf(stderr, "Unknown transport: %s\n", names[i]);
+                    usage(argv[0]);
+                }
+                tp_count++;
+            }
+            break;
+        }
+        case 'm':
+            mode_count = parse_list(optarg, modes, MAX_LIST);
+            break;
+        case 's':
+            size_count = parse_int_list(optarg, sizes, MAX_LIST);
+            break;
+        case 'p':
+            prod_count = parse_int_list(optarg, prods, MAX_LIST);
+            break;
+        case 'c':
+            cons_count = parse_int_list(optarg, cons, MAX_LIST);
+            break;
+        case 'n':
+            messages = atoi(optarg);
+            break;
+        case 'g':
+            gap_us = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (tp_count == 0) {
+        for (int i = 0; i < TRANSPORT_COUNT; i++) {
+            tps[tp_count++] = &transports[i];
+        }
+    }
+    if (messages <= 0) {
+        usage(argv[0]);
+    }
+
+    printf("transport,mode,size,producers,consumers,messages,elapsed_ns,msg_per_s,mib_per_s,"
+           "lat_avg_ns,lat_p50_ns,lat_p99_ns,lat_max_ns\n");
+
+    for (int t = 0; t < tp_count; t++) {
+        const Transport *tp = tps[t];
+        for (int m = 0; m < mode_count; m++) {
+            int pingpong = strcmp(modes[m], "pingpong") == 0;
+            if (!pingpong && strcmp(modes[m], "latency") != 0 && strcmp(modes[m], "throughput") != 0) {
+                fprintf(stderr, "Unknown mode: %s\n", modes[m]);
+                usage(argv[0]);
+            }
+            if (tp->signal_only && strcmp(modes[m], "latency") == 0) {
+                fprintf(stderr, "%s: skipping latency, no payload for a timestamp\n", tp->name);
+                continue;
+            }
+            for (int s = 0; s < size_count; s++) {
+                int size = tp->signal_only ? (int)sizeof(uint64_t) : sizes[s];
+                if (tp->signal_only && s > 0) {
+                    break; // eventfd ma jeden rozmiar
+                }
+                if (size < (int)sizeof(MsgHeader) || size > tp->max_size) {
+                    fprintf(stderr, "%s: skipping size %d (allowed %d..%d)\n", tp->name, size,
+                            (int)sizeof(MsgHeader), tp->max_size);
+                    continue;
+                }
+                for (int p = 0; p < prod_count; p++) {
+                    for (int c = 0; c < cons_count; c++) {
+                        Config cfg = {modes[m], size, prods[p], cons[c], messages, gap_us};
+                        if (pingpong) {
+                            if (p > 0 || c > 0) {
+                                continue;
+                            }
+                            cfg.producers = cfg.consumers = 1;
+                        }
+                        if (cfg.producers < 1 || cfg.consumers < 1 ||
+                            cfg.producers + cfg.consumers > MAX_PROCS) {
+                            fprintf(stderr, "Invalid producers/consumers: %d/%d\n", cfg.producers, cfg.consumers);
+                            continue;
+                        }
+                        if (tp->single_consumer && cfg.consumers > 1) {
+                            fprintf(stderr, "%s: skipping %d consumers, mq_notify allows one\n", tp->name,
+                                    cfg.consumers);
+                            continue;
+                        }
+                        cfg.messages -= cfg.messages % (cfg.producers * cfg.consumers);
+                        if (cfg.messages == 0) {
+                            continue;
+                        }
+                        run(tp, &cfg);
+                    }
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,130 +1,413 @@
+// gcc pipe4.c chat.c history.c session.c trace.c transport.c -lrt -lpthread
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
-#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
 #include <sys/types.h>
-#include <sys/stat.h>
-#include <mqueue.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stddef.h>
 
-#define MAX_CLIENTS 8
-#define MSG_SIZE 256
-#define QUEUE_NAME_LEN 64
+#include "chat.h"
+#include "history.h"
+#include "session.h"
+#include "trace.h"
 
-// Struktura klienta
-typedef struct {
-    char name[QUEUE_NAME_LEN];
-    mqd_t queue;
-} Client;
+// Rejestr sesji w pamięci dzielonej, przeżywa restart serwera
+SessionTable *sessions;
+pthread_mutex_t sessions_lock = PTHREAD_MUTEX_INITIALIZER;
+Endpoint *server_queue;
+Endpoint *control_queue;
+const char *server_name;
+char server_queue_name[QUEUE_NAME_SIZE];
+char control_queue_name[QUEUE_NAME_SIZE];
+// Czy na kolejce czeka zarejestrowane powiadomienie
+int server_armed = 0;
+int control_armed = 0;
+timer_t refill_timer;
+TraceWriter *trace;
+HistoryRing *history;
+volatile sig_atomic_t restart_signal = 0;
+volatile sig_atomic_t stop_signal = 0;
 
-// Struktura wiadomości
-typedef struct {
-    char sender[QUEUE_NAME_LEN];
-    char text[MSG_SIZE];
-} Message;
-
-Client clients[MAX_CLIENTS];
-int client_count = 0;
-mqd_t server_queue;
-char server_queue_name[QUEUE_NAME_LEN];
+// Deskryptory kolejek serwera i chwila rozpoczęcia restartu, dla nowego obrazu
+#define HANDOVER_ENV "SOP_CHAT_HANDOVER"
 
 void handle_sigint(int sig);
-void register_notification();
+void register_notification(Endpoint *queue, int *armed);
 void handle_message(union sigval data);
 
+// Kolejka klienta, nieblokująca: klient z pełną kolejką traci wiadomość,
+// zamiast wstrzymywać serwer. Po restarcie otwieramy ją dopiero przy
+// pierwszej wysyłce. NULL, gdy klienta już nie ma - wtedy sesję usunie
+// finish_sessions, żeby nie zajmowała miejsca w rejestrze.
+Endpoint *client_queue(Session *session, const HistoryRequest *request) {
+    if (session->queue == NULL && !session->closing) {
+        unsigned int frame = request != NULL ? request->frame : session->history.frame;
+        size_t size = frame > sizeof(Message) ? frame : sizeof(Message);
+        session->queue = chat_open(session->name, EP_WRITE | EP_NONBLOCK, size);
+        if (session->queue == NULL && (errno == ENOENT || errno == ECONNREFUSED)) {
+            session->closing = 1; // klient zniknął bez MSG_DISCONNECT, np. razem z poprzednim serwerem
+        }
+    }
+    return session->queue;
+}
+
+// Wywołujący trzyma sessions_lock
 void send_to_all_clients(const char *sender, const char *msg) {
     Message message;
-    snprintf(message.sender, QUEUE_NAME_LEN, "%s", sender);
+    snprintf(message.sender, QUEUE_NAME_SIZE, "%s", sender);
     snprintf(message.text, MSG_SIZE, "%s", msg);
 
-    for (int i = 0; i < client_count; ++i) {
-        mq_send(clients[i].queue, (char*)&message, sizeof(Message), 2);
+    for (int i = 0; i < sessions->count; ++i) {
+        if (sessions->sessions[i].closing) {
+            continue; // już nie odbiera
+        }
+        Endpoint *queue = client_queue(&sessions->sessions[i], NULL);
+        if (queue != NULL) {
+            endpoint_send(queue, &message, sizeof(Message), MSG_TEXT);
+        }
     }
 }
 
-void register_notification() {
-    struct sigevent sev;
-    sev.sigev_notify = SIGEV_THREAD;
-    sev.sigev_notify_function = handle_message;
-    sev.sigev_notify_attributes = NULL;
-    sev.sigev_value.sival_ptr = &server_queue;
-    
-    if (mq_notify(server_queue, &sev) == -1) {
-        perror("mq_notify");
+// Historia trzyma wiadomości bez końcowych zer pola text
+void append_history(const char *sender, const char *text) {
+    Message message;
+    snprintf(message.sender, QUEUE_NAME_SIZE, "%s", sender);
+    snprintf(message.text, MSG_SIZE, "%s", text);
+    history_append(history, &message, offsetof(Message, text) + strlen(message.text) + 1);
+}
+
+// Ramka historii dla session_stream_history; klient bez ramek dostaje
+// zwykłe wiadomości. Klienta, którego kolejki nie da się otworzyć, już
+// nie ma - jego historia przepada.
+int send_history(Session *session, const void *frame, size_t len) {
+    Endpoint *queue = client_queue(session, NULL);
+    if (queue == NULL) {
+        return -1;
+    }
+    if (session->history.frame > 0) {
+        return endpoint_send(queue, frame, len, MSG_HISTORY);
+    }
+    Message message = {};
+    memcpy(&message, frame, len);
+    return endpoint_send(queue, &message, sizeof(Message), MSG_TEXT);
+}
+
+void register_notification(Endpoint *queue, int *armed) {
+    union sigval sv = {.sival_ptr = armed};
+    if (endpoint_notify(queue, handle_message, sv) == -1) {
+        perror("endpoint_notify");
         exit(EXIT_FAILURE);
     }
+    *armed = 1;
 }
 
-void handle_message(union sigval data) {
-    mqd_t *queue = (mqd_t*)data.sival_ptr;
-    Message message;
-    unsigned int priority;
-
-    register_notification();
-    
-    while (mq_receive(*queue, (char*)&message, sizeof(Message), &priority) != -1) {
-        if (priority == 0) { // Nowy klient
-            if (client_count < MAX_CLIENTS) {
-                strcpy(clients[client_count].name, message.sender);
-                char client_queue_name[QUEUE_NAME_LEN];
-                snprintf(client_queue_name, QUEUE_NAME_LEN, "/chat_%s", message.sender);
-                clients[client_count].queue = mq_open(client_queue_name, O_WRONLY);
-                if (clients[client_count].queue == -1) {
-                    perror("mq_open client");
-                    continue;
+// Przy MSG_CONNECT pole text może zawierać prośbę o historię (history.h)
+void handle_session(unsigned int priority, const char *sender, const char *request_text) {
+    if (priority == MSG_CONNECT) { // Nowy klient
+        HistoryRequest request;
+        history_parse_request(request_text, &request);
+        Session *session = session_find(sessions, sender);
+        if (session != NULL) {
+            // Klient wrócił z nową kolejką - stary deskryptor wskazuje na usuniętą
+            endpoint_close(session->queue);
+            session->queue = NULL;
+            session->closing = 0;
+            client_queue(session, &request);
+            history_seek(history, &session->history, &request);
+            return;
+        }
+        if (sessions->count == MAX_SESSIONS) {
+            return;
+        }
+        session = session_add(sessions, sender, NULL);
+        if (client_queue(session, &request) == NULL) {
+            perror("endpoint_open client");
+            session_remove(sessions, sender, NULL);
+            return;
+        }
+        history_seek(history, &session->history, &request);
+        printf("Client %s has connected!\n", sender);
+    } else if (priority == MSG_DISCONNECT) { // Klient się rozłączył
+        Session *session = session_find(sessions, sender);
+        if (session != NULL) {
+            session->closing = 1; // usunie ją finish_sessions
+        }
+    }
+}
+
+// Usuwa rozłączonych klientów, których wiadomości już rozesłano. Wołać
+// po opróżnieniu kolejki serwera.
+void finish_sessions(void) {
+    Session *session;
+    while ((session = session_finished(sessions)) != NULL) {
+        char name[QUEUE_NAME_SIZE];
+        unsigned long dropped;
+        snprintf(name, QUEUE_NAME_SIZE, "%s", session->name);
+        endpoint_close(session_remove(sessions, name, &dropped));
+        printf("Client %s disconnected! (%lu messages dropped)\n", name, dropped);
+    }
+}
+
+// Odbiera wszystko, co czeka w kolejce, po MAX_MSG naraz. Łączenie i
+// rozłączanie obsługujemy od razu, tekst trafia do zaległości nadawcy.
+void drain(Endpoint *queue) {
+    Message messages[MAX_MSG];
+    TransportMsg batch[MAX_MSG];
+    int received;
+    unsigned int lane = queue == control_queue ? TRACE_LANE_CONTROL : TRACE_LANE_DATA;
+
+    while (1) {
+        for (int i = 0; i < MAX_MSG; i++) {
+            batch[i].buf = &messages[i];
+            batch[i].len = sizeof(Message);
+        }
+        if ((received = endpoint_receive_batch(queue, batch, MAX_MSG)) == -1) {
+            break;
+        }
+        for (int m = 0; m < received; m++) {
+            Message *message = &messages[m];
+            trace_record(trace, message->sender, lane, batch[m].prio, message, batch[m].len);
+            if (batch[m].prio == MSG_TEXT) { // Wiadomość tekstowa
+                Session *session = session_find(sessions, message->sender);
+                if (session != NULL) {
+                    session_enqueue(session, message, sizeof(Message));
                 }
-                printf("Client %s has connected!\n", message.sender);
-                client_count++;
+            } else {
+                message->text[MSG_SIZE - 1] = 0;
+                handle_session(batch[m].prio, message->sender, message->text);
             }
-        } else if (priority == 1) { // Klient się rozłączył
-            for (int i = 0; i < client_count; i++) {
-                if (strcmp(clients[i].name, message.sender) == 0) {
-                    mq_close(clients[i].queue);
-                    printf("Client %s disconnected!\n", clients[i].name);
-                    clients[i] = clients[--client_count];
-                    break;
-                }
+        }
+    }
+    if (errno != EAGAIN) perror("endpoint_receive_batch");
+}
+
+// Rozsyła zaległości rundami, po jednej wiadomości od klienta z żetonem.
+// Przed każdą rundą sprawdza kanał sterujący, żeby nowi klienci nie czekali.
+void dispatch() {
+    Message message;
+    size_t len;
+
+    int streaming = session_stream_history(sessions, history, send_history);
+    while (1) {
+        // Kolejka serwera po kanale sterującym: tekst rozłączającego się
+        // klienta trafia do zaległości, zanim sesja zniknie
+        drain(control_queue);
+        drain(server_queue);
+        finish_sessions();
+        double now = session_now();
+        int sent = 0;
+        for (int i = 0; i < sessions->count; i++) {
+            if (session_next(sessions, now, &message, &len) == NULL) {
+                break;
             }
-        } else if (priority == 2) { // Wiadomość tekstowa
             printf("[%s] %s\n", message.sender, message.text);
             send_to_all_clients(message.sender, message.text);
+            append_history(message.sender, message.text);
+            sent++;
+        }
+        if (sent == 0) {
+            break;
         }
     }
-    if (errno != EAGAIN) perror("mq_receive");
+
+    // Zaległości czekające na żeton - obudź się, gdy go dostaną;
+    // niedokończona historia - wróć do niej za chwilę
+    double wait = session_wait(sessions, session_now());
+    if (streaming && (wait <= 0 || wait > HISTORY_INTERVAL)) {
+        wait = HISTORY_INTERVAL;
+    }
+    if (wait > 0) {
+        struct itimerspec its = {};
+        its.it_value.tv_sec = (time_t)wait;
+        its.it_value.tv_nsec = (long)((wait - (time_t)wait) * 1e9) + 1;
+        timer_settime(refill_timer, 0, &its, NULL);
+    }
+}
+
+// Wywoływana z powiadomień obu kolejek i z timera (armed == NULL)
+void handle_message(union sigval data) {
+    int *armed = (int *)data.sival_ptr;
+
+    pthread_mutex_lock(&sessions_lock);
+    if (armed != NULL) {
+        *armed = 0;
+    }
+    drain(control_queue);
+    drain(server_queue);
+    dispatch();
+
+    // Powiadomienia rejestrujemy po opróżnieniu kolejek
+    if (!control_armed) {
+        register_notification(control_queue, &control_armed);
+    }
+    if (!server_armed) {
+        register_notification(server_queue, &server_armed);
+    }
+    pthread_mutex_unlock(&sessions_lock);
 }
 
 void handle_sigint(int sig) {
+    stop_signal = 1;
+}
+
+// Ctrl+C: sprzątanie w wątku głównym, pod sessions_lock, żeby nie trafić
+// w środek obsługi kolejek ani w wątek zapisu śladu
+void shutdown_server(void) {
+    pthread_mutex_lock(&sessions_lock);
     send_to_all_clients("SERVER", "Server closed the connection");
-    for (int i = 0; i < client_count; i++) {
-        mq_close(clients[i].queue);
+    trace_close(trace);
+    history_close(history);
+    history_unlink(server_name);
+    for (int i = 0; i < sessions->count; i++) {
+        endpoint_close(sessions->sessions[i].queue);
     }
-    mq_close(server_queue);
-    mq_unlink(server_queue_name);
+    session_table_unmap(sessions);
+    session_table_unlink(server_name);
+    endpoint_close(control_queue);
+    endpoint_unlink(control_queue_name);
+    endpoint_close(server_queue);
+    endpoint_unlink(server_queue_name);
     exit(0);
 }
 
+void handle_sigusr2(int sig) {
+    restart_signal = 1;
+}
+
+// Gorący restart (SIGUSR2): uruchamia od nowa plik programu, np. po jego
+// podmianie. Nowy obraz przejmuje kolejki serwera przez exec() i rejestr
+// sesji z pamięci dzielonej, więc klienci niczego nie zauważają, a
+// wiadomości wysłane w międzyczasie czekają w kolejce serwera.
+void hot_restart(char *argv[]) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Czekamy, aż wątki obsługi skończą; exec() zabije je razem z timerem
+    pthread_mutex_lock(&sessions_lock);
+    trace_close(trace);
+    history_close(history);
+    char handover[64];
+    snprintf(handover, sizeof(handover), "%d,%d,%lld", endpoint_handover_fd(server_queue),
+             endpoint_handover_fd(control_queue), (long long)start.tv_sec * 1000000000ll + start.tv_nsec);
+    setenv(HANDOVER_ENV, handover, 1);
+    printf("Restarting server...\n");
+    fflush(stdout);
+
+    execvp(argv[0], argv);
+
+    perror("execvp");
+    unsetenv(HANDOVER_ENV);
+    trace = trace_from_env(TRACE_SERVER_PIPE4);
+    history = history_from_env(server_name);
+    restart_signal = 0;
+    pthread_mutex_unlock(&sessions_lock);
+}
+
 int main(int argc, char *argv[]) {
     if (argc != 2) {
         fprintf(stderr, "Usage: %s <server_name>\n", argv[0]);
         exit(EXIT_FAILURE);
     }
-    snprintf(server_queue_name, QUEUE_NAME_LEN, "/chat_%s", argv[1]);
-    struct mq_attr attr = { .mq_maxmsg = 10, .mq_msgsize = sizeof(Message) };
-    server_queue = mq_open(server_queue_name, O_RDONLY | O_CREAT | O_NONBLOCK, 0600, &attr);
-    if (server_queue == -1) {
-        perror("mq_open server");
+    server_name = argv[1];
+    chat_queue_name(server_queue_name, argv[1]);
+    chat_control_name(control_queue_name, argv[1]);
+
+    // Po gorącym restarcie kolejki serwera są już otwarte
+    int server_fd = -1, control_fd = -1;
+    long long restart_ns = 0;
+    const char *handover = getenv(HANDOVER_ENV);
+    if (handover != NULL) {
+        sscanf(handover, "%d,%d,%lld", &server_fd, &control_fd, &restart_ns);
+        unsetenv(HANDOVER_ENV);
+    }
+    server_queue = endpoint_adopt(server_fd, server_queue_name, EP_READ | EP_CREATE | EP_NONBLOCK,
+                                  sizeof(Message), MAX_MSG);
+    if (server_queue == NULL) {
+        perror("endpoint_open server");
+        exit(EXIT_FAILURE);
+    }
+    control_queue = endpoint_adopt(control_fd, control_queue_name, EP_READ | EP_CREATE | EP_NONBLOCK,
+                                   sizeof(Message), MAX_MSG);
+    if (control_queue == NULL) {
+        perror("endpoint_open control");
+        exit(EXIT_FAILURE);
+    }
+    int resumed;
+    if ((sessions = session_table_map(argv[1], &resumed)) == NULL) {
+        perror("session_table_map");
+        exit(EXIT_FAILURE);
+    }
+
+    // SIGUSR2 i SIGINT mają trafić do wątku głównego (przerwać fgets), więc
+    // wątki powiadomień, timera i zapisu śladu tworzymy z zablokowanymi sygnałami
+    sigset_t main_only;
+    sigemptyset(&main_only);
+    sigaddset(&main_only, SIGUSR2);
+    sigaddset(&main_only, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &main_only, NULL);
+
+    struct sigevent sev = {};
+    sev.sigev_notify = SIGEV_THREAD;
+    sev.sigev_notify_function = handle_message;
+    sev.sigev_value.sival_ptr = NULL;
+    if (timer_create(CLOCK_MONOTONIC, &sev, &refill_timer) == -1) {
+        perror("timer_create");
         exit(EXIT_FAILURE);
     }
-    signal(SIGINT, handle_sigint);
-    register_notification();
-    printf("Server started: %s\n", argv[1]);
+
+    trace = trace_from_env(TRACE_SERVER_PIPE4);
+    history = history_from_env(server_name);
+    // Bez SA_RESTART, żeby sygnał przerwał fgets
+    struct sigaction sa = {};
+    sa.sa_handler = handle_sigusr2;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR2, &sa, NULL);
+    sa.sa_handler = handle_sigint;
+    sigaction(SIGINT, &sa, NULL);
+
+    // Sesje z rejestru, których klienci już nie żyją, usunie pierwsza obsługa
+    int restored = sessions->count;
+    for (int i = 0; i < sessions->count; i++) {
+        client_queue(&sessions->sessions[i], NULL);
+    }
+
+    // Pierwsza obsługa od razu zabiera to, co czekało w kolejkach podczas restartu
+    union sigval none = {.sival_ptr = NULL};
+    handle_message(none);
+    pthread_sigmask(SIG_UNBLOCK, &main_only, NULL);
+
+    if (handover != NULL) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double ms = ((long long)now.tv_sec * 1000000000ll + now.tv_nsec - restart_ns) / 1e6;
+        printf("Server resumed: %s (%d sessions, %.2f ms)\n", argv[1], sessions->count, ms);
+    } else if (resumed) {
+        printf("Server started: %s (%d of %d sessions restored)\n", argv[1], sessions->count, restored);
+    } else {
+        printf("Server started: %s\n", argv[1]);
+    }
     while (1) {
         char input[MSG_SIZE];
+        if (stop_signal) {
+            shutdown_server();
+        }
+        if (restart_signal) {
+            hot_restart(argv);
+        }
         if (fgets(input, MSG_SIZE, stdin) != NULL) {
             input[strcspn(input, "\n")] = 0;
+            pthread_mutex_lock(&sessions_lock);
             send_to_all_clients("SERVER", input);
+            append_history("SERVER", input);
+            pthread_mutex_unlock(&sessions_lock);
+        } else if (feof(stdin)) {
+            pause(); // bez wejścia czekamy już tylko na sygnały
+        } else {
+            clearerr(stdin); // fgets przerwany sygnałem
         }
     }
     return 0;
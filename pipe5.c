@@ -1,6 +1,6 @@
+// gcc pipe5.c chat.c history.c session.c trace.c transport.c -lrt -lpthread
 #include <errno.h>
-#include <fcntl.h>
-#include <mqueue.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
@@ -9,162 +9,333 @@
 #include <unistd.h>
 #include <sys/wait.h>
 
-#define MSG_SIZE 256
-#define QUEUE_NAME_SIZE 64
-#define MAX_CLIENTS 8
+#include "chat.h"
+#include "history.h"
+#include "session.h"
+#include "trace.h"
 
-#define MSG_CONNECT 0
-#define MSG_DISCONNECT 1
-#define MSG_TEXT 2
+Endpoint *server_queue;
+Endpoint *control_queue;
+SessionTable sessions;
+TraceWriter *trace;
+HistoryRing *history;
+volatile sig_atomic_t stop_signal = 0;
 
-#define ERR(source) \
-    (fprintf(stderr, "%s:%d\n", __FILE__, __LINE__), perror(source), exit(EXIT_FAILURE))
-
-typedef struct {
-    char name[QUEUE_NAME_SIZE];
-    mqd_t queue;
-} ClientData;
-
-mqd_t server_queue;
-ClientData clients[MAX_CLIENTS];
-int client_count = 0;
+void handle_sigint(int sig) {
+    stop_signal = 1;
+}
 
-void register_notification(mqd_t queue);
+void register_notification(Endpoint *queue);
 void handle_messages(union sigval sv);
-void send_message(mqd_t queue, const char *message, unsigned int prio);
 
-void register_notification(mqd_t queue) {
-    struct sigevent sev = {};
-    sev.sigev_notify = SIGEV_THREAD;
-    sev.sigev_notify_function = handle_messages;
-    sev.sigev_value.sival_ptr = &queue;
-
-    if (mq_notify(queue, &sev) == -1) {
-        ERR("mq_notify");
+void register_notification(Endpoint *queue) {
+    union sigval sv = {.sival_ptr = queue};
+    if (endpoint_notify(queue, handle_messages, sv) == -1) {
+        ERR("endpoint_notify");
     }
 }
 
 void handle_messages(union sigval sv) {
-    mqd_t *queue = (mqd_t *)sv.sival_ptr;
-    char message[MSG_SIZE];
+    Endpoint *queue = (Endpoint *)sv.sival_ptr;
+    char message[HISTORY_FRAME_SIZE];
     unsigned int prio;
+    ssize_t len;
 
-    while (mq_receive(*queue, message, MSG_SIZE, &prio) != -1) {
+    while ((len = endpoint_receive(queue, message, HISTORY_FRAME_SIZE, &prio)) != -1) {
         if (prio == MSG_TEXT) {
             printf("%s\n", message);
+        } else if (prio == MSG_HISTORY) {
+            // Messages sent before we joined, several per frame
+            size_t offset = 0, text_len;
+            const char *text;
+            while ((text = history_unpack(message, len, &offset, &text_len)) != NULL) {
+                printf("%.*s\n", (int)strnlen(text, text_len), text);
+            }
         } else if (prio == MSG_DISCONNECT) {
             printf("Server closed the connection.\n");
-            mq_close(*queue);
+            endpoint_close(queue);
             exit(EXIT_SUCCESS);
         }
     }
+    // Queue drained - wait for more messages
+    register_notification(queue);
 }
 
-void send_message(mqd_t queue, const char *message, unsigned int prio) {
-    if (mq_send(queue, message, strlen(message) + 1, prio) == -1) {
-        ERR("mq_send");
+// Sends a message to everyone. Client queues are non-blocking: a slow
+// client with a full queue loses the message instead of stalling the server.
+void broadcast(const char *message, size_t len) {
+    for (int i = 0; i < sessions.count; ++i) {
+        if (sessions.sessions[i].closing) {
+            continue; // no longer listening
+        }
+        endpoint_send(sessions.sessions[i].queue, message, len, MSG_TEXT);
     }
 }
 
-void server_function(char *server_name) {
-    // Open the server queue
-    char server_queue_name[QUEUE_NAME_SIZE];
-    snprintf(server_queue_name, QUEUE_NAME_SIZE, "/chat_%s", server_name);
-    server_queue = mq_open(server_queue_name, O_RDONLY | O_CREAT, 0600, NULL);
-    if (server_queue == (mqd_t)-1) {
-        ERR("mq_open server");
+// Connect carries the client name, optionally followed by a history request
+const char *connect_request(char *message, size_t len) {
+    size_t name_len = strnlen(message, len);
+    if (name_len + 1 >= len) {
+        return "";
     }
+    message[len < MSG_SIZE ? len : MSG_SIZE - 1] = 0;
+    return message + name_len + 1;
+}
 
-    // Handle incoming messages
-    char message[MSG_SIZE];
-    unsigned int prio;
+// Connect or disconnect, whichever lane it came on
+void handle_session(unsigned int prio, const char *name, const char *request_text) {
+    if (prio == MSG_CONNECT) {
+        // New client connection, or one that reconnects before its backlog went out
+        Session *session = session_find(&sessions, name);
+        if ((session != NULL && !session->closing) || (session == NULL && sessions.count == MAX_SESSIONS)) {
+            return;
+        }
+        HistoryRequest request;
+        history_parse_request(request_text, &request);
+        Endpoint *queue = chat_open(name, EP_WRITE | EP_NONBLOCK, request.frame > MSG_SIZE ? request.frame : MSG_SIZE);
+        if (queue == NULL) {
+            perror("endpoint_open client");
+            return;
+        }
+        if (session != NULL) {
+            endpoint_close(session->queue);
+            session->queue = queue;
+            session->closing = 0;
+        } else {
+            session = session_add(&sessions, name, queue);
+        }
+        printf("Client %s has connected!\n", name);
+        const char *welcome = "Welcome to the chat!";
+        endpoint_send(queue, welcome, strlen(welcome) + 1, MSG_TEXT);
+        history_seek(history, &session->history, &request);
+    } else if (prio == MSG_DISCONNECT) {
+        // The disconnect may overtake the client's text, which is still on
+        // the server queue; finish_sessions removes the session later
+        Session *session = session_find(&sessions, name);
+        if (session != NULL) {
+            session->closing = 1;
+        }
+    }
+}
+
+// Removes disconnected clients whose backlog has been sent out. Call only
+// after the server queue has been drained.
+void finish_sessions(void) {
+    Session *session;
+    while ((session = session_finished(&sessions)) != NULL) {
+        char name[QUEUE_NAME_SIZE];
+        unsigned long dropped;
+        snprintf(name, QUEUE_NAME_SIZE, "%s", session->name);
+        endpoint_close(session_remove(&sessions, name, &dropped));
+        printf("Client %s disconnected (%lu messages dropped)\n", name, dropped);
+    }
+}
+
+// Session management lane, always drained before any text is handled
+void handle_control(void) {
+    char messages[MAX_MSG][MSG_SIZE];
+    TransportMsg batch[MAX_MSG];
+    int received;
 
     while (1) {
-        if (mq_receive(server_queue, message, MSG_SIZE, &prio) != -1) {
-            if (prio == MSG_CONNECT) {
-                // New client connection
-                if (client_count < MAX_CLIENTS) {
-                    snprintf(clients[client_count].name, QUEUE_NAME_SIZE, "%s", message);
-                    char client_queue_name[QUEUE_NAME_SIZE];
-                    snprintf(client_queue_name, QUEUE_NAME_SIZE, "/chat_%s", message);
-
-                    clients[client_count].queue = mq_open(client_queue_name, O_WRONLY);
-                    if (clients[client_count].queue == (mqd_t)-1) {
-                        ERR("mq_open client");
-                    }
-
-                    printf("Client %s has connected!\n", message);
-                    send_message(clients[client_count].queue, "Welcome to the chat!", MSG_TEXT);
-                    client_count++;
-                }
-            } else if (prio == MSG_DISCONNECT) {
-                // Handle disconnection
-                printf("A client disconnected\n");
-            } else if (prio == MSG_TEXT) {
-                // Broadcast the message to all clients
-                for (int i = 0; i < client_count; ++i) {
-                    char formatted_msg[MSG_SIZE];
-                    snprintf(formatted_msg, MSG_SIZE, "[%s] %s", message, message);
-                    send_message(clients[i].queue, formatted_msg, MSG_TEXT);
-                }
+        for (int i = 0; i < MAX_MSG; i++) {
+            batch[i].buf = messages[i];
+            batch[i].len = MSG_SIZE;
+        }
+        if ((received = endpoint_receive_batch(control_queue, batch, MAX_MSG)) == -1) {
+            if (errno != EAGAIN) {
+                ERR("endpoint_receive_batch control");
             }
-        } else {
+            return;
+        }
+        for (int m = 0; m < received; m++) {
+            trace_record(trace, messages[m], TRACE_LANE_CONTROL, batch[m].prio, messages[m], batch[m].len);
+            handle_session(batch[m].prio, messages[m], connect_request(messages[m], batch[m].len));
+        }
+    }
+}
+
+// Takes everything off the server queue into per-client backlogs, so one
+// client flooding the queue cannot keep the others' messages out of it
+void collect_text(void) {
+    char messages[MAX_MSG][MSG_SIZE];
+    TransportMsg batch[MAX_MSG];
+    int received;
+
+    while (1) {
+        for (int i = 0; i < MAX_MSG; i++) {
+            batch[i].buf = messages[i];
+            batch[i].len = MSG_SIZE;
+        }
+        if ((received = endpoint_receive_batch(server_queue, batch, MAX_MSG)) == -1) {
             if (errno != EAGAIN) {
-                ERR("mq_receive");
+                ERR("endpoint_receive_batch");
             }
+            return;
         }
+        for (int m = 0; m < received; m++) {
+            if (batch[m].prio != MSG_TEXT) {
+                // Old clients still connect through the server queue
+                trace_record(trace, messages[m], TRACE_LANE_DATA, batch[m].prio, messages[m], batch[m].len);
+                handle_session(batch[m].prio, messages[m], connect_request(messages[m], batch[m].len));
+                continue;
+            }
+            // Client sends "[name] text"
+            char name[QUEUE_NAME_SIZE] = "";
+            int named = sscanf(messages[m], "[%63[^]]]", name) == 1;
+            trace_record(trace, name, TRACE_LANE_DATA, MSG_TEXT, messages[m], batch[m].len);
+            Session *session;
+            if (!named || (session = session_find(&sessions, name)) == NULL) {
+                continue;
+            }
+            session_enqueue(session, messages[m], batch[m].len);
+        }
+    }
+}
+
+// One round: at most one message from every client that has a token
+void dispatch_round(void) {
+    char message[SESSION_SLOT_SIZE];
+    size_t len;
+    double now = session_now();
+    for (int i = 0; i < sessions.count; i++) {
+        if (session_next(&sessions, now, message, &len) == NULL) {
+            break;
+        }
+        printf("%s\n", message);
+        broadcast(message, len);
+        history_append(history, message, len);
+    }
+}
+
+// History frame for session_stream_history. History entries are the
+// broadcast strings themselves, so a client without frames gets them as text.
+int send_history(Session *session, const void *frame, size_t len) {
+    unsigned int prio = session->history.frame > 0 ? MSG_HISTORY : MSG_TEXT;
+    return endpoint_send(session->queue, frame, len, prio);
+}
+
+void server_function(char *server_name) {
+    // Open the server queue and the control lane
+    char server_queue_name[QUEUE_NAME_SIZE], control_queue_name[QUEUE_NAME_SIZE];
+    chat_queue_name(server_queue_name, server_name);
+    chat_control_name(control_queue_name, server_name);
+    server_queue = chat_open(server_name, EP_READ | EP_CREATE | EP_NONBLOCK, MSG_SIZE);
+    if (server_queue == NULL) {
+        ERR("endpoint_open server");
+    }
+    control_queue = chat_open_control(server_name, EP_READ | EP_CREATE | EP_NONBLOCK, MSG_SIZE);
+    if (control_queue == NULL) {
+        ERR("endpoint_open control");
+    }
+
+    struct pollfd fds[2] = {
+        {endpoint_fd(control_queue), POLLIN, 0},
+        {endpoint_fd(server_queue), POLLIN, 0},
+    };
+    if (fds[0].fd == -1 || fds[1].fd == -1) {
+        ERR("endpoint_fd");
+    }
+
+    // No SA_RESTART: Ctrl+C interrupts poll() and ends the loop
+    struct sigaction sa = {};
+    sa.sa_handler = handle_sigint;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGINT, &sa, NULL) == -1) {
+        ERR("sigaction");
+    }
+    trace = trace_from_env(TRACE_SERVER_PIPE5);
+    history = history_from_env(server_name);
+    int streaming = 0;
+
+    while (!stop_signal) {
+        // Wake up when a message arrives or a rate-limited backlog gets a token
+        double wait = session_wait(&sessions, session_now());
+        if (streaming && (wait < 0 || wait > HISTORY_INTERVAL)) {
+            wait = HISTORY_INTERVAL;
+        }
+        int timeout = wait < 0 ? -1 : (int)(wait * 1000 + 0.999);
+        if (poll(fds, 2, timeout) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ERR("poll");
+        }
+        handle_control();
+        collect_text();
+        streaming = session_stream_history(&sessions, history, send_history);
+        dispatch_round();
+        finish_sessions();
     }
 
     // Cleanup and close
-    mq_close(server_queue);
-    mq_unlink(server_queue_name);
+    unsigned long dropped = trace_close(trace);
+    if (dropped > 0) {
+        printf("Trace buffer full, %lu records not recorded\n", dropped);
+    }
+    history_close(history);
+    history_unlink(server_name);
+    for (int i = 0; i < sessions.count; i++) {
+        endpoint_close(sessions.sessions[i].queue);
+    }
+    endpoint_close(control_queue);
+    endpoint_unlink(control_queue_name);
+    endpoint_close(server_queue);
+    endpoint_unlink(server_queue_name);
 }
 
 void client_function(char *server_name, char *client_name) {
     // Create a unique client queue
     char client_queue_name[QUEUE_NAME_SIZE];
-    snprintf(client_queue_name, QUEUE_NAME_SIZE, "/chat_%s", client_name);
-    mqd_t client_queue = mq_open(client_queue_name, O_RDONLY | O_CREAT | O_NONBLOCK, 0600, NULL);
-    if (client_queue == (mqd_t)-1) {
-        ERR("mq_open client");
+    chat_queue_name(client_queue_name, client_name);
+    Endpoint *client_queue = chat_open(client_name, EP_READ | EP_CREATE | EP_NONBLOCK, HISTORY_FRAME_SIZE);
+    if (client_queue == NULL) {
+        ERR("endpoint_open client");
     }
 
     // Connect to the server
-    char server_queue_name[QUEUE_NAME_SIZE];
-    snprintf(server_queue_name, QUEUE_NAME_SIZE, "/chat_%s", server_name);
-    mqd_t server_queue = mq_open(server_queue_name, O_WRONLY);
-    if (server_queue == (mqd_t)-1) {
-        ERR("mq_open server");
+    Endpoint *server_queue = chat_open(server_name, EP_WRITE, MSG_SIZE);
+    if (server_queue == NULL) {
+        ERR("endpoint_open server");
+    }
+    // Servers without a control lane (pipeServer) take connects on the server queue
+    Endpoint *control_queue = chat_open_control(server_name, EP_WRITE, MSG_SIZE);
+    if (control_queue == NULL) {
+        control_queue = server_queue;
     }
 
-    // Send a connection message
-    send_message(server_queue, client_name, MSG_CONNECT);
+    // Send a connection message, asking for what was said before we joined
+    char connect[MSG_SIZE];
+    HistoryRequest request = {HISTORY_FRAME_SIZE, HISTORY_COUNT, 0};
+    size_t name_len = strlen(client_name) + 1;
+    snprintf(connect, MSG_SIZE, "%s", client_name);
+    history_format_request(connect + name_len, MSG_SIZE - name_len, &request);
+    if (endpoint_send(control_queue, connect, name_len + strlen(connect + name_len) + 1, MSG_CONNECT) == -1) {
+        ERR("endpoint_send");
+    }
 
     // Register for receiving messages
     register_notification(client_queue);
 
-    // Chat loop
+    // Chat loop, until end of input
     char message[MSG_SIZE];
-    while (1) {
-        if (fgets(message, MSG_SIZE, stdin) != NULL) {
-            if (strlen(message) == 0) {
-                break;
-            }
-
-            message[strcspn(message, "\n")] = 0;  // Remove newline character
-            char formatted_msg[MSG_SIZE];
-            snprintf(formatted_msg, MSG_SIZE, "[%s] %s", client_name, message);
-            send_message(server_queue, formatted_msg, MSG_TEXT);
-        }
+    while (fgets(message, MSG_SIZE, stdin) != NULL) {
+        message[strcspn(message, "\n")] = 0;  // Remove newline character
+        char formatted_msg[MSG_SIZE];
+        snprintf(formatted_msg, MSG_SIZE, "[%s] %s", client_name, message);
+        send_message(server_queue, formatted_msg, MSG_TEXT);
     }
 
     // Send disconnect message
-    send_message(server_queue, "", MSG_DISCONNECT);
+    send_message(control_queue, client_name, MSG_DISCONNECT);
 
     // Cleanup
-    mq_close(client_queue);
-    mq_unlink(client_queue_name);
-    mq_close(server_queue);
+    endpoint_close(client_queue);
+    endpoint_unlink(client_queue_name);
+    if (control_queue != server_queue) {
+        endpoint_close(control_queue);
+    }
+    endpoint_close(server_queue);
 }
 
 int main(int argc, char *argv[]) {
@@ -1,45 +1,26 @@
 // klient.c
+// gcc pipeClient.c chat.c transport.c -lrt -lpthread
 #include <errno.h>
-#include <fcntl.h>
-#include <mqueue.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-#define MSG_SIZE 256
-#define QUEUE_NAME_SIZE 64
-
-#define MSG_CONNECT 0
-#define MSG_DISCONNECT 1
-#define MSG_TEXT 2
-
-#define ERR(source) \
-    (fprintf(stderr, "%s:%d\n", __FILE__, __LINE__), perror(source), exit(EXIT_FAILURE))
-
-void send_message(mqd_t queue, const char *message, unsigned int prio);
-
-void send_message(mqd_t queue, const char *message, unsigned int prio) {
-    if (mq_send(queue, message, strlen(message) + 1, prio) == -1) {
-        ERR("mq_send");
-    }
-}
+#include "chat.h"
 
 void client_function(char *server_name, char *client_name) {
     // Create a unique client queue
     char client_queue_name[QUEUE_NAME_SIZE];
-    snprintf(client_queue_name, QUEUE_NAME_SIZE, "/chat_%s", client_name);
-    mqd_t client_queue = mq_open(client_queue_name, O_RDONLY | O_CREAT | O_NONBLOCK, 0600, NULL);
-    if (client_queue == (mqd_t)-1) {
-        ERR("mq_open client");
+    chat_queue_name(client_queue_name, client_name);
+    Endpoint *client_queue = chat_open(client_name, EP_READ | EP_CREATE | EP_NONBLOCK, MSG_SIZE);
+    if (client_queue == NULL) {
+        ERR("endpoint_open client");
     }
 
     // Connect to the server
-    char server_queue_name[QUEUE_NAME_SIZE];
-    snprintf(server_queue_name, QUEUE_NAME_SIZE, "/chat_%s", server_name);
-    mqd_t server_queue = mq_open(server_queue_name, O_WRONLY);
-    if (server_queue == (mqd_t)-1) {
-        ERR("mq_open server");
+    Endpoint *server_queue = chat_open(server_name, EP_WRITE, MSG_SIZE);
+    if (server_queue == NULL) {
+        ERR("endpoint_open server");
     }
 
     // Send a connection message
@@ -62,9 +43,9 @@ void client_function(char *server_name, char *client_name) {
     send_message(server_queue, "", MSG_DISCONNECT);
 
     // Cleanup
-    mq_close(client_queue);
-    mq_unlink(client_queue_name);
-    mq_close(server_queue);
+    endpoint_close(client_queue);
+    endpoint_unlink(client_queue_name);
+    endpoint_close(server_queue);
 }
 
 int main(int argc, char *argv[]) {
@@ -1,47 +1,31 @@
 // serwer.c
+// gcc pipeServer.c chat.c transport.c -lrt -lpthread
 #include <errno.h>
-#include <fcntl.h>
-#include <mqueue.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
-#define MSG_SIZE 256
-#define QUEUE_NAME_SIZE 64
-#define MAX_CLIENTS 8
-
-#define MSG_CONNECT 0
-#define MSG_DISCONNECT 1
-#define MSG_TEXT 2
+#include "chat.h"
 
-#define ERR(source) \
-    (fprintf(stderr, "%s:%d\n", __FILE__, __LINE__), perror(source), exit(EXIT_FAILURE))
+#define MAX_CLIENTS 8
 
 typedef struct {
     char name[QUEUE_NAME_SIZE];
-    mqd_t queue;
+    Endpoint *queue;
 } ClientData;
 
-mqd_t server_queue;
+Endpoint *server_queue;
 ClientData clients[MAX_CLIENTS];
 int client_count = 0;
 
-void send_message(mqd_t queue, const char *message, unsigned int prio);
-
-void send_message(mqd_t queue, const char *message, unsigned int prio) {
-    if (mq_send(queue, message, strlen(message) + 1, prio) == -1) {
-        ERR("mq_send");
-    }
-}
-
 void server_function(char *server_name) {
     // Open the server queue
     char server_queue_name[QUEUE_NAME_SIZE];
-    snprintf(server_queue_name, QUEUE_NAME_SIZE, "/chat_%s", server_name);
-    server_queue = mq_open(server_queue_name, O_RDONLY | O_CREAT, 0600, NULL);
-    if (server_queue == (mqd_t)-1) {
-        ERR("mq_open server");
+    chat_queue_name(server_queue_name, server_name);
+    server_queue = chat_open(server_name, EP_READ | EP_CREATE, MSG_SIZE);
+    if (server_queue == NULL) {
+        ERR("endpoint_open server");
     }
 
     // Handle incoming messages
@@ -49,17 +33,14 @@ void server_function(char *server_name) {
     unsigned int prio;
 
     while (1) {
-        if (mq_receive(server_queue, message, MSG_SIZE, &prio) != -1) {
+        if (endpoint_receive(server_queue, message, MSG_SIZE, &prio) != -1) {
             if (prio == MSG_CONNECT) {
                 // New client connection
                 if (client_count < MAX_CLIENTS) {
                     snprintf(clients[client_count].name, QUEUE_NAME_SIZE, "%s", message);
-                    char client_queue_name[QUEUE_NAME_SIZE];
-                    snprintf(client_queue_name, QUEUE_NAME_SIZE, "/chat_%s", message);
-
-                    clients[client_count].queue = mq_open(client_queue_name, O_WRONLY);
-                    if (clients[client_count].queue == (mqd_t)-1) {
-                        ERR("mq_open client");
+                    clients[client_count].queue = chat_open(message, EP_WRITE, MSG_SIZE);
+                    if (clients[client_count].queue == NULL) {
+                        ERR("endpoint_open client");
                     }
 
                     printf("Client %s has connected!\n", message);
@@ -79,14 +60,14 @@ void server_function(char *server_name) {
             }
         } else {
             if (errno != EAGAIN) {
-                ERR("mq_receive");
+                ERR("endpoint_receive");
             }
         }
     }
 
     // Cleanup and close
-    mq_close(server_queue);
-    mq_unlink(server_queue_name);
+    endpoint_close(server_queue);
+    endpoint_unlink(server_queue_name);
 }
 
 int main(int argc, char *argv[]) {
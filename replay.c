@@ -0,0 +1,376 @@
+// replay.c
+// Odtwarza ruch nagrany przez serwer czatu (SOP_TRACE, trace.h) na serwerze
+// pipe4, pipe5 albo pipeServer, w dowolnym transporcie (SOP_TRANSPORT).
+// Domyślnie cel jest tego samego rodzaju co serwer, który nagrywał;
+// -s pipe4|pipe5|pipeServer wybiera inny i wtedy treść wiadomości jest
+// tłumaczona na jego format (pipeServer przyjmuje napisy jak pipe5). Serwer
+// bez kanału sterującego dostaje wszystko na swoją kolejkę.
+//
+// Dla każdej sesji z nagrania tworzy kolejkę klienta /chat_<nazwa>, wysyła
+// zapisane wiadomości w oryginalnych odstępach podzielonych przez <speed>
+// (0 = tak szybko, jak się da) i mierzy opóźnienie od wysłania wiadomości
+// do powrotu jej rozgłoszonej kopii do nadawcy. Wiadomość, której kopia nie
+// wróciła, a wróciła późniejsza od tego samego nadawcy, liczy się jako utracona.
+//
+// Wynik w CSV na stdout, tak jak w ipcbench.c.
+//
+// Kompilacja: gcc -O2 -o replay replay.c chat.c trace.c transport.c -lrt -lpthread
+// Przykład:   SOP_TRACE=ruch.trc ./pipe5 prod   ...   ./replay -x 10 ruch.trc test
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chat.h"
+#include "trace.h"
+
+#define REPLAY_MSG_SIZE 1024
+#define REPLAY_SESSIONS 64
+#define PENDING_MAX 64
+#define DRAIN_NS 1000000000ull
+// pipeServer nie nagrywa, więc nie ma swojego TRACE_SERVER_*
+#define REPLAY_PIPESERVER 1
+
+typedef struct {
+    uint32_t id;
+    char name[QUEUE_NAME_SIZE];
+    Endpoint *queue;
+    // Wysłane, jeszcze bez powrotu: czas i wysłana treść
+    uint64_t sent_ns[PENDING_MAX];
+    char key[PENDING_MAX][sizeof(Message)];
+    size_t key_len[PENDING_MAX];
+    int head;
+    int count;
+} ReplaySession;
+
+ReplaySession sessions[REPLAY_SESSIONS];
+int session_count = 0;
+
+uint64_t *latencies = NULL;
+size_t latency_count = 0, latency_cap = 0;
+unsigned long lost = 0;
+
+// Rodzaj serwera, któremu wysyłamy (TRACE_SERVER_* albo REPLAY_PIPESERVER)
+unsigned int target = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static ReplaySession *find_session(uint32_t id) {
+    for (int i = 0; i < session_count; i++) {
+        if (sessions[i].id == id) {
+            return &sessions[i];
+        }
+    }
+    return NULL;
+}
+
+// Sesję poznajemy po MSG_CONNECT, którego treść zaczyna się od nazwy klienta
+static void open_session(uint32_t id, const char *payload) {
+    if (find_session(id) != NULL) {
+        return;
+    }
+    if (session_count == REPLAY_SESSIONS) {
+        fprintf(stderr, "Too many sessions, %.*s not tracked\n", (int)strnlen(payload, QUEUE_NAME_SIZE - 1), payload);
+        return;
+    }
+    ReplaySession *s = &sessions[session_count];
+    memset(s, 0, sizeof(*s));
+    s->id = id;
+    snprintf(s->name, QUEUE_NAME_SIZE, "%.*s", (int)strnlen(payload, QUEUE_NAME_SIZE - 1), payload);
+    s->queue = chat_open(s->name, EP_READ | EP_CREATE | EP_NONBLOCK, REPLAY_MSG_SIZE);
+    if (s->queue == NULL) {
+        ERR("endpoint_open client");
+    }
+    session_count++;
+}
+
+static void add_latency(uint64_t ns) {
+    if (latency_count == latency_cap) {
+        latency_cap = latency_cap ? latency_cap * 2 : 4096;
+        if ((latencies = realloc(latencies, latency_cap * sizeof(uint64_t))) == NULL) {
+            ERR("realloc");
+        }
+    }
+    latencies[latency_count++] = ns;
+}
+
+// Treść do porównania wysłanej wiadomości z kopią: w pipe5 cały napis, w
+// pipe4 nadawca i tekst bez śmieci za końcowymi zerami pól struktury Message
+static size_t echo_key(const char *payload, size_t len, char *key) {
+    if (target != TRACE_SERVER_PIPE4) {
+        len = len < sizeof(Message) ? len : sizeof(Message);
+        memcpy(key, payload, len);
+        return len;
+    }
+    Message message = {};
+    memcpy(&message, payload, len < sizeof(Message) ? len : sizeof(Message));
+    size_t sender_len = strnlen(message.sender, QUEUE_NAME_SIZE - 1);
+    size_t text_len = strnlen(message.text, MSG_SIZE - 1);
+    memcpy(key, message.sender, sender_len);
+    key[sender_len] = 0;
+    memcpy(key + sender_len + 1, message.text, text_len);
+    key[sender_len + 1 + text_len] = 0;
+    return sender_len + text_len + 2;
+}
+
+static void remember_sent(ReplaySession *s, const char *payload, size_t len, uint64_t ts) {
+    if (s->count == PENDING_MAX) {
+        s->head = (s->head + 1) % PENDING_MAX;
+        s->count--;
+        lost++;
+    }
+    char echo[MSG_SIZE];
+    if (target == REPLAY_PIPESERVER) {
+        // pipeServer odsyła "[treść] treść", przycięte do MSG_SIZE
+        int n = (int)strnlen(payload, len < MSG_SIZE ? len : MSG_SIZE - 1);
+        snprintf(echo, MSG_SIZE, "[%.*s] %.*s", n, payload, n, payload);
+        payload = echo;
+        len = strlen(echo) + 1;
+    }
+    int slot = (s->head + s->count) % PENDING_MAX;
+    s->sent_ns[slot] = ts;
+    s->key_len[slot] = echo_key(payload, len, s->key[slot]);
+    s->count++;
+}
+
+static void match_echo(ReplaySession *s, const char *payload, size_t len, uint64_t ts) {
+    char key[sizeof(Message)];
+    size_t key_len = echo_key(payload, len, key);
+    for (int i = 0; i < s->count; i++) {
+        int slot = (s->head + i) % PENDING_MAX;
+        if (key_len == s->key_len[slot] && memcmp(s->key[slot], key, key_len) == 0) {
+            add_latency(ts - s->sent_ns[slot]);
+            lost += i; // starsze bez kopii serwer porzucił
+            s->head = (slot + 1) % PENDING_MAX;
+            s->count -= i + 1;
+            return;
+        }
+    }
+}
+
+static void receive_all(void) {
+    char buf[REPLAY_MSG_SIZE];
+    for (int i = 0; i < session_count; i++) {
+        ssize_t n;
+        unsigned int prio;
+        while ((n = endpoint_receive(sessions[i].queue, buf, REPLAY_MSG_SIZE, &prio)) != -1 || errno == EMSGSIZE) {
+            // Historia (MSG_HISTORY) nie jest kopią niczego, co wysłaliśmy
+            if (n == -1 || prio == MSG_HISTORY) {
+                continue;
+            }
+            match_echo(&sessions[i], buf, n, now_ns());
+        }
+        if (errno != EAGAIN) {
+            ERR("endpoint_receive");
+        }
+    }
+}
+
+static void wait_for_messages(uint64_t timeout_ns) {
+    struct pollfd fds[REPLAY_SESSIONS];
+    for (int i = 0; i < session_count; i++) {
+        fds[i].fd = endpoint_fd(sessions[i].queue);
+        fds[i].events = POLLIN;
+    }
+    int timeout = (int)((timeout_ns + 999999) / 1000000);
+    if (poll(fds, session_count, timeout) == -1 && errno != EINTR) {
+        ERR("poll");
+    }
+    receive_all();
+}
+
+// Treść nagrana przez serwer from w formacie serwera to; zwraca długość
+static size_t convert_payload(unsigned int from, unsigned int to, unsigned int type, const char *payload, size_t size,
+                              char *out) {
+    if (from == to) {
+        memcpy(out, payload, size);
+        return size;
+    }
+    if (to == TRACE_SERVER_PIPE4) {
+        Message message = {};
+        if (type == MSG_TEXT) {
+            // "[nadawca] tekst"
+            int n = 0;
+            sscanf(payload, "[%63[^]]] %n", message.sender, &n);
+            snprintf(message.text, MSG_SIZE, "%s", payload + n);
+        } else {
+            // Nazwa, po niej ewentualnie prośba o historię
+            size_t name_len = strnlen(payload, size);
+            snprintf(message.sender, QUEUE_NAME_SIZE, "%.*s", (int)strnlen(payload, QUEUE_NAME_SIZE - 1), payload);
+            if (name_len + 1 < size) {
+                snprintf(message.text, MSG_SIZE, "%.*s", (int)(size - name_len - 1), payload + name_len + 1);
+            }
+        }
+        memcpy(out, &message, sizeof(Message));
+        return sizeof(Message);
+    }
+    Message message = {};
+    memcpy(&message, payload, size < sizeof(Message) ? size : sizeof(Message));
+    message.sender[QUEUE_NAME_SIZE - 1] = 0;
+    message.text[MSG_SIZE - 1] = 0;
+    if (type == MSG_TEXT) {
+        int sender_len = (int)strlen(message.sender);
+        snprintf(out, MSG_SIZE, "[%.*s] %.*s", sender_len, message.sender, MSG_SIZE - 4 - sender_len, message.text);
+        return strlen(out) + 1;
+    }
+    size_t len = strlen(message.sender) + 1;
+    memcpy(out, message.sender, len);
+    if (message.text[0] != 0) {
+        snprintf(out + len, MSG_SIZE - len, "%s", message.text);
+        len += strlen(out + len) + 1;
+    }
+    return len;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-x speed] [-s pipe4|pipe5|pipeServer] <trace_file> <server_name>\n"
+                    "  speed: 1 - real time (default), N - N times faster, 0 - as fast as possible\n"
+                    "  -s: kind of the target server (default: the one that recorded the trace)\n",
+            prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    double speed = 1.0;
+    int opt;
+    while ((opt = getopt(argc, argv, "x:s:")) != -1) {
+        if (opt == 'x') {
+            speed = atof(optarg);
+        } else if (opt == 's' && strcmp(optarg, "pipe4") == 0) {
+            target = TRACE_SERVER_PIPE4;
+        } else if (opt == 's' && strcmp(optarg, "pipe5") == 0) {
+            target = TRACE_SERVER_PIPE5;
+        } else if (opt == 's' && strcmp(optarg, "pipeServer") == 0) {
+            target = REPLAY_PIPESERVER;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2 || speed < 0) {
+        usage(argv[0]);
+    }
+
+    unsigned int recorded;
+    FILE *file = trace_read_open(argv[optind], &recorded);
+    if (file == NULL) {
+        ERR("trace_read_open");
+    }
+    if (target == 0) {
+        target = recorded;
+    }
+    unsigned int format = target == REPLAY_PIPESERVER ? TRACE_SERVER_PIPE5 : target;
+    Endpoint *server_queue = chat_open(argv[optind + 1], EP_WRITE | EP_NONBLOCK, REPLAY_MSG_SIZE);
+    if (server_queue == NULL) {
+        ERR("endpoint_open server");
+    }
+    // Jak klient pipe5: serwer bez kanału sterującego obsługuje go na swojej kolejce
+    Endpoint *control_queue = chat_open_control(argv[optind + 1], EP_WRITE | EP_NONBLOCK, REPLAY_MSG_SIZE);
+    if (control_queue == NULL) {
+        control_queue = server_queue;
+    }
+
+    TraceRecord rec;
+    char payload[UINT16_MAX + 1], converted[REPLAY_MSG_SIZE];
+    unsigned long records = 0, sent = 0;
+    int have = trace_read(file, &rec, payload, UINT16_MAX);
+    uint64_t start = now_ns();
+    uint64_t last_sent = start;
+
+    while (have == 1) {
+        uint64_t due = start + (speed > 0 ? (uint64_t)(rec.ts_ns / speed) : 0);
+        uint64_t now = now_ns();
+        if (now < due) {
+            wait_for_messages(due - now);
+            continue;
+        }
+
+        payload[rec.size] = 0;
+        if (rec.type == MSG_CONNECT) {
+            open_session(rec.session, payload);
+        }
+        Endpoint *queue = rec.lane == TRACE_LANE_CONTROL ? control_queue : server_queue;
+        size_t len = convert_payload(recorded, format, rec.type, payload, rec.size, converted);
+        uint64_t send_ts = now_ns(); // przed wysłaniem: serwer może odpowiedzieć, zanim send wróci
+        if (endpoint_send(queue, converted, len, rec.type) == -1) {
+            if (errno != EAGAIN) {
+                ERR("endpoint_send");
+            }
+            wait_for_messages(1000000); // serwer nie nadąża, spróbuj za chwilę
+            continue;
+        }
+        last_sent = now_ns();
+        ReplaySession *s;
+        if (rec.type == MSG_TEXT && (s = find_session(rec.session)) != NULL) {
+            remember_sent(s, converted, len, send_ts);
+        }
+        sent++;
+        records++;
+        receive_all();
+        have = trace_read(file, &rec, payload, UINT16_MAX);
+    }
+    if (have == -1) {
+        fprintf(stderr, "Trace truncated after %lu records\n", records);
+    }
+
+    // Ostatnie kopie mogą jeszcze wracać
+    uint64_t deadline = now_ns() + DRAIN_NS;
+    while (now_ns() < deadline) {
+        int outstanding = 0;
+        for (int i = 0; i < session_count; i++) {
+            outstanding += sessions[i].count;
+        }
+        if (outstanding == 0) {
+            break;
+        }
+        wait_for_messages(deadline - now_ns());
+    }
+    for (int i = 0; i < session_count; i++) {
+        lost += sessions[i].count;
+    }
+
+    double elapsed = (double)(last_sent - start);
+    printf("trace,server,transport,speed,records,elapsed_ns,msg_per_s,echoed,lost,"
+           "lat_avg_ns,lat_p50_ns,lat_p99_ns,lat_max_ns\n");
+    printf("%s,%s,%s,%g,%lu,%.0f,%.0f,%zu,%lu", argv[optind], argv[optind + 1], transport_name(transport_default()),
+           speed, sent, elapsed, elapsed > 0 ? sent / (elapsed / 1e9) : 0.0, latency_count, lost);
+    if (latency_count > 0) {
+        qsort(latencies, latency_count, sizeof(uint64_t), cmp_u64);
+        double sum = 0;
+        for (size_t i = 0; i < latency_count; i++) {
+            sum += latencies[i];
+        }
+        printf(",%.0f,%llu,%llu,%llu\n", sum / latency_count, (unsigned long long)latencies[latency_count / 2],
+               (unsigned long long)latencies[latency_count * 99 / 100],
+               (unsigned long long)latencies[latency_count - 1]);
+    } else {
+        printf(",,,,\n");
+    }
+
+    for (int i = 0; i < session_count; i++) {
+        char queue_name[QUEUE_NAME_SIZE];
+        chat_queue_name(queue_name, sessions[i].name);
+        endpoint_close(sessions[i].queue);
+        endpoint_unlink(queue_name);
+    }
+    if (control_queue != server_queue) {
+        endpoint_close(control_queue);
+    }
+    endpoint_close(server_queue);
+    fclose(file);
+    free(latencies);
+    return EXIT_SUCCESS;
+}
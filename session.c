@@ -0,0 +1,219 @@
+// session.c
+#include "session.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define REGISTRY_MAGIC 0x534f5053u
+
+typedef struct {
+    unsigned int magic;
+    unsigned int size;
+    SessionTable table;
+} SessionRegistry;
+
+double session_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void registry_name(char *name, const char *server_name) {
+    snprintf(name, QUEUE_NAME_SIZE, "/chat_%s.reg", server_name);
+}
+
+SessionTable *session_table_map(const char *server_name, int *resumed) {
+    char name[QUEUE_NAME_SIZE];
+    registry_name(name, server_name);
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd == -1) {
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(SessionRegistry)) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return NULL;
+    }
+    SessionRegistry *reg = mmap(NULL, sizeof(SessionRegistry), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (reg == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Segment z inną wersją programu (inny rozmiar) zaczynamy od nowa
+    *resumed = reg->magic == REGISTRY_MAGIC && reg->size == sizeof(SessionRegistry);
+    if (!*resumed) {
+        memset(reg, 0, sizeof(SessionRegistry));
+        reg->magic = REGISTRY_MAGIC;
+        reg->size = sizeof(SessionRegistry);
+    }
+    for (int i = 0; i < reg->table.count; i++) {
+        reg->table.sessions[i].queue = NULL;
+    }
+    return &reg->table;
+}
+
+void session_table_unmap(SessionTable *table) {
+    munmap((char *)table - offsetof(SessionRegistry, table), sizeof(SessionRegistry));
+}
+
+int session_table_unlink(const char *server_name) {
+    char name[QUEUE_NAME_SIZE];
+    registry_name(name, server_name);
+    return shm_unlink(name);
+}
+
+static void bucket_refill(TokenBucket *bucket, double now) {
+    bucket->tokens += (now - bucket->last) * bucket->rate;
+    if (bucket->tokens > bucket->burst) {
+        bucket->tokens = bucket->burst;
+    }
+    bucket->last = now;
+}
+
+void bucket_init(TokenBucket *bucket, double rate, double burst, double now) {
+    bucket->tokens = burst;
+    bucket->rate = rate;
+    bucket->burst = burst;
+    bucket->last = now;
+}
+
+int bucket_take(TokenBucket *bucket, double now) {
+    bucket_refill(bucket, now);
+    if (bucket->tokens < 1.0) {
+        return 0;
+    }
+    bucket->tokens -= 1.0;
+    return 1;
+}
+
+double bucket_wait(const TokenBucket *bucket, double now) {
+    double tokens = bucket->tokens + (now - bucket->last) * bucket->rate;
+    if (tokens >= 1.0) {
+        return 0.0;
+    }
+    return (1.0 - tokens) / bucket->rate;
+}
+
+Session *session_add(SessionTable *table, const char *name, Endpoint *queue) {
+    if (table->count == MAX_SESSIONS) {
+        return NULL;
+    }
+    Session *session = &table->sessions[table->count++];
+    memset(session, 0, sizeof(Session));
+    snprintf(session->name, QUEUE_NAME_SIZE, "%s", name);
+    session->queue = queue;
+    bucket_init(&session->bucket, RATE_LIMIT, RATE_BURST, session_now());
+    return session;
+}
+
+Session *session_find(SessionTable *table, const char *name) {
+    for (int i = 0; i < table->count; i++) {
+        if (strcmp(table->sessions[i].name, name) == 0) {
+            return &table->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+Session *session_finished(SessionTable *table) {
+    for (int i = 0; i < table->count; i++) {
+        if (table->sessions[i].closing && table->sessions[i].count == 0) {
+            return &table->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+Endpoint *session_remove(SessionTable *table, const char *name, unsigned long *dropped) {
+    Session *session = session_find(table, name);
+    if (session == NULL) {
+        return NULL;
+    }
+    Endpoint *queue = session->queue;
+    if (dropped != NULL) {
+        *dropped = session->dropped + session->count;
+    }
+    *session = table->sessions[--table->count];
+    if (table->next >= table->count) {
+        table->next = 0;
+    }
+    return queue;
+}
+
+int session_enqueue(Session *session, const void *msg, size_t len) {
+    if (session->count == SESSION_BACKLOG || len > SESSION_SLOT_SIZE) {
+        session->dropped++;
+        return -1;
+    }
+    int slot = (session->head + session->count) % SESSION_BACKLOG;
+    memcpy(session->pending[slot], msg, len);
+    session->pending_len[slot] = len;
+    session->count++;
+    return 0;
+}
+
+Session *session_next(SessionTable *table, double now, void *msg, size_t *len) {
+    for (int i = 0; i < table->count; i++) {
+        int idx = (table->next + i) % table->count;
+        Session *session = &table->sessions[idx];
+        if (session->count == 0 || !bucket_take(&session->bucket, now)) {
+            continue;
+        }
+        memcpy(msg, session->pending[session->head], session->pending_len[session->head]);
+        *len = session->pending_len[session->head];
+        session->head = (session->head + 1) % SESSION_BACKLOG;
+        session->count--;
+        table->next = (idx + 1) % table->count;
+        return session;
+    }
+    return NULL;
+}
+
+double session_wait(const SessionTable *table, double now) {
+    double wait = -1.0;
+    for (int i = 0; i < table->count; i++) {
+        const Session *session = &table->sessions[i];
+        if (session->count == 0) {
+            continue;
+        }
+        double w = bucket_wait(&session->bucket, now);
+        if (wait < 0 || w < wait) {
+            wait = w;
+        }
+    }
+    return wait;
+}
+
+int session_stream_history(SessionTable *table, HistoryRing *ring, HistorySend send) {
+    char frame[HISTORY_FRAME_SIZE];
+    int pending = 0;
+    for (int i = 0; i < table->count; i++) {
+        Session *session = &table->sessions[i];
+        if (session->closing) {
+            session->history.next = session->history.end;
+        }
+        for (int f = 0; f < HISTORY_FRAMES_PER_ROUND; f++) {
+            unsigned int entries;
+            size_t len = history_frame(ring, &session->history, frame, &entries);
+            if (len == 0) {
+                break;
+            }
+            if (send(session, frame, len) == -1) {
+                if (errno != EAGAIN) {
+                    session->history.next = session->history.end;
+                }
+                break;
+            }
+            history_advance(&session->history, entries);
+        }
+        pending |= history_pending(&session->history);
+    }
+    return pending;
+}
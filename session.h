@@ -0,0 +1,88 @@
+// session.h
+// Sesje klientów po stronie serwera czatu: limit wiadomości tekstowych na
+// klienta (token bucket) i sprawiedliwe rozsyłanie po kolei (round-robin),
+// żeby jeden gadatliwy klient nie zagłodził pozostałych.
+//
+// Serwer najpierw zabiera wszystko z kolejki do zaległości sesji, potem
+// w każdej rundzie rozsyła co najwyżej jedną wiadomość od każdego klienta,
+// który ma żeton. Wiadomości ponad SESSION_BACKLOG są odrzucane.
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "chat.h"
+#include "history.h"
+
+#define MAX_SESSIONS 8
+#define SESSION_BACKLOG 16
+#define SESSION_SLOT_SIZE (QUEUE_NAME_SIZE + MSG_SIZE)
+
+// Domyślny limit: RATE_LIMIT wiadomości na sekundę, chwilowo do RATE_BURST
+#define RATE_LIMIT 20.0
+#define RATE_BURST 40.0
+
+typedef struct {
+    double tokens;
+    double rate;
+    double burst;
+    double last;
+} TokenBucket;
+
+typedef struct {
+    char name[QUEUE_NAME_SIZE];
+    Endpoint *queue; // ważne tylko w procesie, który je otworzył; NULL = otworzyć przy wysyłce
+    TokenBucket bucket;
+    char pending[SESSION_BACKLOG][SESSION_SLOT_SIZE];
+    size_t pending_len[SESSION_BACKLOG];
+    int head;
+    int count;
+    unsigned long dropped;
+    HistoryCursor history; // jeszcze niewysłana historia pokoju
+    int closing;           // klient się rozłączył, zostały mu zaległości do rozesłania
+} Session;
+
+typedef struct {
+    Session sessions[MAX_SESSIONS];
+    int count;
+    int next;
+} SessionTable;
+
+double session_now(void);
+
+// Tablica sesji w pamięci dzielonej /chat_<server>.reg, żeby przeżyła
+// restart serwera. *resumed = 1, gdy segment już istniał; wskaźniki do
+// kolejek klientów są wtedy zerowane, bo należały do poprzedniego procesu.
+SessionTable *session_table_map(const char *server_name, int *resumed);
+void session_table_unmap(SessionTable *table);
+int session_table_unlink(const char *server_name);
+
+void bucket_init(TokenBucket *bucket, double rate, double burst, double now);
+int bucket_take(TokenBucket *bucket, double now);
+double bucket_wait(const TokenBucket *bucket, double now);
+
+Session *session_add(SessionTable *table, const char *name, Endpoint *queue);
+Session *session_find(SessionTable *table, const char *name);
+// Zwraca kolejkę usuniętej sesji (do zamknięcia przez wywołującego) albo NULL.
+// *dropped obejmuje też nierozesłane zaległości.
+Endpoint *session_remove(SessionTable *table, const char *name, unsigned long *dropped);
+// MSG_DISCONNECT przychodzi kanałem sterującym, więc może wyprzedzić tekst
+// klienta. Sesję z closing usuwa się dopiero, gdy serwer opróżnił swoją
+// kolejkę po rozłączeniu i rozesłał zaległości; to ją zwraca session_finished.
+Session *session_finished(SessionTable *table);
+
+// -1, gdy zaległości klienta są pełne i wiadomość została odrzucona
+int session_enqueue(Session *session, const void *msg, size_t len);
+// Następna wiadomość do rozesłania w kolejności round-robin albo NULL
+Session *session_next(SessionTable *table, double now, void *msg, size_t *len);
+// Sekundy do chwili, gdy jakaś zaległa wiadomość dostanie żeton; -1 gdy brak zaległości
+double session_wait(const SessionTable *table, double now);
+
+// Wysyła ramkę historii (przy session->history.frame == 0 jedną wiadomość)
+// w formacie danego serwera; -1 z errno jak endpoint_send
+typedef int (*HistorySend)(Session *session, const void *frame, size_t len);
+
+// Po HISTORY_FRAMES_PER_ROUND ramek historii dla każdego świeżo dołączonego
+// klienta. Klient, który nie przyjmie ramki z innego powodu niż EAGAIN, traci
+// resztę historii. Zwraca 1, gdy komuś jeszcze coś zostało do wysłania.
+int session_stream_history(SessionTable *table, HistoryRing *ring, HistorySend send);
+
+#endif
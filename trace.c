@@ -0,0 +1,230 @@
+// trace.c
+#include "trace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct TraceWriter {
+    FILE *file;
+    char *buf;
+    size_t head; // pisze tylko serwer
+    size_t tail; // pisze tylko wątek zapisujący
+    int stop;
+    unsigned long dropped;
+    uint64_t start_ns;
+    pthread_t thread;
+};
+
+static uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint32_t trace_session_id(const char *name) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash = (hash ^ (unsigned char)*name) * 16777619u;
+    }
+    return hash;
+}
+
+static void *trace_thread(void *arg) {
+    TraceWriter *w = arg;
+    const struct timespec idle = {0, 1000000};
+
+    while (1) {
+        int stop = __atomic_load_n(&w->stop, __ATOMIC_ACQUIRE);
+        size_t head = __atomic_load_n(&w->head, __ATOMIC_ACQUIRE);
+        size_t tail = w->tail;
+        if (head == tail) {
+            if (stop) {
+                break;
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        size_t start = tail & (TRACE_BUFFER_SIZE - 1);
+        size_t len = head - tail;
+        if (start + len > TRACE_BUFFER_SIZE) {
+            len = TRACE_BUFFER_SIZE - start;
+        }
+        fwrite(w->buf + start, 1, len, w->file);
+        fflush(w->file); // przerwany serwer traci najwyżej ostatnią chwilę
+        __atomic_store_n(&w->tail, tail + len, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+TraceWriter *trace_open(const char *path, unsigned int server) {
+    TraceWriter *w = calloc(1, sizeof(TraceWriter));
+    if (w == NULL) {
+        return NULL;
+    }
+    if ((w->buf = malloc(TRACE_BUFFER_SIZE)) == NULL) {
+        goto fail;
+    }
+
+    // Dopisywanie do istniejącego nagrania; pusty plik traktujemy jak nowy
+    char magic[TRACE_MAGIC_SIZE];
+    uint32_t recorded;
+    if ((w->file = fopen(path, "r+b")) != NULL) {
+        size_t n = fread(magic, 1, TRACE_MAGIC_SIZE, w->file);
+        if (n == 0 && feof(w->file)) {
+            fclose(w->file);
+            w->file = NULL;
+        } else if (n != TRACE_MAGIC_SIZE || memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0 ||
+                   fread(&w->start_ns, sizeof(w->start_ns), 1, w->file) != 1 ||
+                   fread(&recorded, sizeof(recorded), 1, w->file) != 1 || recorded != server) {
+            // Nagranie innego serwera albo w ogóle nie nagranie - nie nadpisujemy
+            errno = EEXIST;
+            goto fail;
+        } else if (fseek(w->file, 0, SEEK_END) == -1) {
+            goto fail;
+        }
+    }
+    if (w->file == NULL) {
+        if ((w->file = fopen(path, "wb")) == NULL) {
+            goto fail;
+        }
+        w->start_ns = trace_now();
+        recorded = server;
+        if (fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_SIZE, w->file) != TRACE_MAGIC_SIZE ||
+            fwrite(&w->start_ns, sizeof(w->start_ns), 1, w->file) != 1 ||
+            fwrite(&recorded, sizeof(recorded), 1, w->file) != 1) {
+            goto fail;
+        }
+    }
+    // Wątek zapisu nie odbiera sygnałów - ich obsługa może go zamykać
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    int rc = pthread_create(&w->thread, NULL, trace_thread, w);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        errno = rc;
+        goto fail;
+    }
+    return w;
+
+fail:;
+    int saved = errno;
+    if (w->file != NULL) {
+        fclose(w->file);
+    }
+    free(w->buf);
+    free(w);
+    errno = saved;
+    return NULL;
+}
+
+TraceWriter *trace_from_env(unsigned int server) {
+    const char *path = getenv("SOP_TRACE");
+    if (path == NULL || *path == '\0') {
+        return NULL;
+    }
+    TraceWriter *w = trace_open(path, server);
+    if (w == NULL && errno == EEXIST) {
+        fprintf(stderr, "trace_open: %s is not a trace of this server, not overwriting it\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (w == NULL) {
+        perror("trace_open");
+        exit(EXIT_FAILURE);
+    }
+    printf("Recording traffic to %s\n", path);
+    return w;
+}
+
+static void trace_put(TraceWriter *w, size_t pos, const void *data, size_t len) {
+    size_t start = pos & (TRACE_BUFFER_SIZE - 1);
+    size_t first = TRACE_BUFFER_SIZE - start < len ? TRACE_BUFFER_SIZE - start : len;
+    memcpy(w->buf + start, data, first);
+    memcpy(w->buf, (const char *)data + first, len - first);
+}
+
+void trace_record(TraceWriter *w, const char *session, unsigned int lane, unsigned int type,
+                  const void *payload, size_t size) {
+    if (w == NULL) {
+        return;
+    }
+    if (size > UINT16_MAX) {
+        size = UINT16_MAX;
+    }
+    size_t stored = size;
+    while (stored > 0 && ((const char *)payload)[stored - 1] == 0) {
+        stored--;
+    }
+
+    TraceRecord rec = {};
+    rec.ts_ns = trace_now() - w->start_ns;
+    rec.session = trace_session_id(session);
+    rec.size = (uint16_t)size;
+    rec.stored = (uint16_t)stored;
+    rec.type = (uint8_t)type;
+    rec.lane = (uint8_t)lane;
+
+    size_t head = w->head;
+    size_t tail = __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE);
+    if (TRACE_BUFFER_SIZE - (head - tail) < sizeof(rec) + stored) {
+        w->dropped++;
+        return;
+    }
+    trace_put(w, head, &rec, sizeof(rec));
+    trace_put(w, head + sizeof(rec), payload, stored);
+    __atomic_store_n(&w->head, head + sizeof(rec) + stored, __ATOMIC_RELEASE);
+}
+
+unsigned long trace_close(TraceWriter *w) {
+    if (w == NULL) {
+        return 0;
+    }
+    __atomic_store_n(&w->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(w->thread, NULL);
+    fclose(w->file);
+    unsigned long dropped = w->dropped;
+    free(w->buf);
+    free(w);
+    return dropped;
+}
+
+FILE *trace_read_open(const char *path, unsigned int *server) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    char magic[TRACE_MAGIC_SIZE];
+    uint64_t start_ns;
+    uint32_t recorded;
+    if (fread(magic, 1, TRACE_MAGIC_SIZE, file) != TRACE_MAGIC_SIZE || memcmp(magic, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0 ||
+        fread(&start_ns, sizeof(start_ns), 1, file) != 1 || fread(&recorded, sizeof(recorded), 1, file) != 1 ||
+        (recorded != TRACE_SERVER_PIPE4 && recorded != TRACE_SERVER_PIPE5)) {
+        fclose(file);
+        errno = EINVAL;
+        return NULL;
+    }
+    *server = recorded;
+    return file;
+}
+
+int trace_read(FILE *file, TraceRecord *rec, void *payload, size_t capacity) {
+    size_t n = fread(rec, 1, sizeof(*rec), file);
+    if (n == 0 && feof(file)) {
+        return 0;
+    }
+    if (n != sizeof(*rec) || rec->stored > rec->size || rec->size > capacity) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (fread(payload, 1, rec->stored, file) != rec->stored) {
+        errno = EINVAL;
+        return -1;
+    }
+    memset((char *)payload + rec->stored, 0, rec->size - rec->stored);
+    return 1;
+}
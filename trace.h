@@ -0,0 +1,62 @@
+// trace.h
+// Nagrywanie ruchu przychodzącego do serwera czatu do zwartego pliku
+// binarnego i jego odczyt (replay.c).
+//
+// Nagrywanie włącza zmienna SOP_TRACE=<plik>. Serwer wrzuca rekordy do
+// bufora pierścieniowego bez blokad, a osobny wątek zapisuje je na dysk.
+// Gdy bufor jest pełny, rekord jest pomijany i liczony, serwer nie czeka.
+// Rekordy może dodawać tylko jeden wątek naraz.
+//
+// Plik: TRACE_MAGIC, czas początku nagrania (uint64_t, CLOCK_MONOTONIC w ns),
+// rodzaj serwera (uint32_t, TRACE_SERVER_*) - od niego zależy format treści,
+// potem rekordy: TraceRecord + stored bajtów treści. Końcowe zera wiadomości
+// nie są zapisywane (size - stored bajtów). Istniejące nagranie tego samego
+// serwera jest dopisywane z zachowaniem czasu początku, np. po restarcie.
+// Innego niepustego pliku trace_open nie rusza i zwraca NULL z errno EEXIST.
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+#define TRACE_MAGIC "SOPTRC2\n"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+// pipe4: treść to struktura Message (chat.h); pipe5: napis "[nadawca] tekst",
+// a MSG_CONNECT/MSG_DISCONNECT to nazwa klienta
+#define TRACE_SERVER_PIPE4 4
+#define TRACE_SERVER_PIPE5 5
+
+#define TRACE_LANE_DATA 0
+#define TRACE_LANE_CONTROL 1
+
+typedef struct __attribute__((packed)) {
+    uint64_t ts_ns;    // od początku nagrania
+    uint32_t session;  // skrót nazwy nadawcy
+    uint16_t size;     // długość wiadomości
+    uint16_t stored;   // zapisane bajty treści
+    uint8_t type;      // priorytet: MSG_CONNECT / MSG_DISCONNECT / MSG_TEXT
+    uint8_t lane;      // TRACE_LANE_DATA albo TRACE_LANE_CONTROL
+    uint16_t reserved;
+} TraceRecord;
+
+typedef struct TraceWriter TraceWriter;
+
+uint32_t trace_session_id(const char *name);
+
+// NULL, gdy SOP_TRACE nie jest ustawione
+TraceWriter *trace_from_env(unsigned int server);
+TraceWriter *trace_open(const char *path, unsigned int server);
+void trace_record(TraceWriter *writer, const char *session, unsigned int lane, unsigned int type,
+                  const void *payload, size_t size);
+// Zapisuje resztę bufora; zwraca liczbę pominiętych rekordów
+unsigned long trace_close(TraceWriter *writer);
+
+// *server dostaje rodzaj serwera, który nagrał plik
+FILE *trace_read_open(const char *path, unsigned int *server);
+// Wypełnia payload do rec->size (resztę zerami). 1 - rekord, 0 - koniec, -1 - błąd
+int trace_read(FILE *file, TraceRecord *rec, void *payload, size_t capacity);
+
+#endif
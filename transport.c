@@ -0,0 +1,666 @@
+// transport.c
+// Backendy dla transport.h: kolejki POSIX, gniazda AF_UNIX i pierścień w
+// pamięci dzielonej.
+#define _GNU_SOURCE
+#include "transport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <mqueue.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define ENDPOINT_NAME_SIZE 64
+#define BELL_PATH_SIZE 96
+#define BATCH_MAX 64
+#define RING_MAGIC 0x534f5052u
+
+// Pierścień w pamięci dzielonej. Liczniki head/tail rosną bez końca,
+// pozycja to licznik modulo slots. Jeśli odbiorca poprosił o deskryptor do
+// poll(), nadawcy przy przejściu pusta -> niepusta wrzucają bajt do FIFO
+// ("dzwonek"), a odbiorca opróżnia je, gdy pierścień znowu jest pusty.
+typedef struct {
+    unsigned int len;
+    unsigned int prio;
+    char data[];
+} RingSlot;
+
+typedef struct {
+    unsigned int magic;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    unsigned long head;
+    unsigned long tail;
+    unsigned int slots;
+    unsigned int stride;
+    size_t msg_size;
+    int has_bell;
+    char data[];
+} Ring;
+
+struct Endpoint {
+    TransportKind kind;
+    int flags;
+    size_t msg_size;
+    int fd;
+    char name[ENDPOINT_NAME_SIZE];
+    Ring *ring;
+    size_t ring_len;
+};
+
+typedef struct {
+    int fd;
+    void (*fn)(union sigval);
+    union sigval value;
+} NotifyArgs;
+
+static const char *transport_names[] = {"mq", "unix", "shm"};
+
+TransportKind transport_default(void) {
+    static int kind = -1;
+    if (kind == -1) {
+        const char *env = getenv("SOP_TRANSPORT");
+        kind = TRANSPORT_MQ;
+        if (env != NULL && *env != '\0') {
+            kind = -1;
+            for (int i = 0; i < (int)(sizeof(transport_names) / sizeof(transport_names[0])); i++) {
+                if (strcmp(env, transport_names[i]) == 0) {
+                    kind = i;
+                }
+            }
+            if (kind == -1) {
+                fprintf(stderr, "Unknown SOP_TRANSPORT: %s (expected mq, unix or shm)\n", env);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+    return (TransportKind)kind;
+}
+
+const char *transport_name(TransportKind kind) {
+    return transport_names[kind];
+}
+
+// ---- kolejki POSIX ----
+
+static int mq_backend_open(Endpoint *ep, long max_msgs) {
+    int oflag = O_CLOEXEC;
+    if ((ep->flags & EP_READ) && (ep->flags & EP_WRITE)) {
+        oflag |= O_RDWR;
+    } else if (ep->flags & EP_READ) {
+        oflag |= O_RDONLY;
+    } else {
+        oflag |= O_WRONLY;
+    }
+    if (ep->flags & EP_CREATE) {
+        oflag |= O_CREAT;
+    }
+    if (ep->flags & EP_NONBLOCK) {
+        oflag |= O_NONBLOCK;
+    }
+    struct mq_attr attr = {0, max_msgs, (long)ep->msg_size, 0};
+    mqd_t queue = mq_open(ep->name, oflag, 0600, &attr);
+    if (queue == (mqd_t)-1) {
+        return -1;
+    }
+    ep->fd = queue;
+    return 0;
+}
+
+static int mq_backend_receive_batch(Endpoint *ep, TransportMsg *msgs, int count) {
+    // Pierwsza wiadomość zgodnie z trybem kolejki, reszta z zerowym limitem czasu
+    static const struct timespec expired = {0, 0};
+    int received = 0;
+    while (received < count) {
+        ssize_t n;
+        if (received == 0) {
+            n = mq_receive(ep->fd, msgs[0].buf, msgs[0].len, &msgs[0].prio);
+        } else {
+            n = mq_timedreceive(ep->fd, msgs[received].buf, msgs[received].len, &msgs[received].prio, &expired);
+        }
+        if (n == -1) {
+            if (received > 0 && (errno == ETIMEDOUT || errno == EAGAIN)) {
+                break;
+            }
+            return received > 0 ? received : -1;
+        }
+        msgs[received++].len = n;
+    }
+    return received;
+}
+
+// ---- gniazda AF_UNIX ----
+
+static socklen_t unix_address(const char *name, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    // Abstrakcyjna przestrzeń nazw: adres znika razem z gniazdem
+    snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "sop%s", name);
+    return offsetof(struct sockaddr_un, sun_path) + 1 + strlen(addr->sun_path + 1);
+}
+
+// Właściciel adresu (czytelnik albo twórca) wiąże gniazdo, piszący się łączy.
+// Wielu czytelników jednego adresu musi dzielić gniazdo odziedziczone po fork().
+static int unix_backend_open(Endpoint *ep, long max_msgs) {
+    struct sockaddr_un addr;
+    socklen_t addr_len = unix_address(ep->name, &addr);
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    int bound = 0;
+    if (ep->flags & (EP_READ | EP_CREATE)) {
+        if (bind(fd, (struct sockaddr *)&addr, addr_len) == 0) {
+            bound = 1;
+            int rcvbuf = (int)(max_msgs * (ep->msg_size + sizeof(unsigned int) + 512));
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        } else if (errno != EADDRINUSE || (ep->flags & EP_READ)) {
+            goto fail;
+        }
+    }
+    if ((ep->flags & EP_WRITE) && connect(fd, (struct sockaddr *)&addr, addr_len) == -1) {
+        goto fail;
+    }
+    if (!bound && !(ep->flags & EP_WRITE)) {
+        errno = EADDRINUSE;
+        goto fail;
+    }
+    if ((ep->flags & EP_NONBLOCK) && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1) {
+        goto fail;
+    }
+    ep->fd = fd;
+    return 0;
+
+fail:;
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+}
+
+static void unix_iov(struct iovec iov[2], unsigned int *prio, void *buf, size_t len) {
+    iov[0].iov_base = prio;
+    iov[0].iov_len = sizeof(*prio);
+    iov[1].iov_base = buf;
+    iov[1].iov_len = len;
+}
+
+static int unix_backend_send_batch(Endpoint *ep, const TransportMsg *msgs, int count) {
+    int sent = 0;
+    while (sent < count) {
+        int chunk = count - sent < BATCH_MAX ? count - sent : BATCH_MAX;
+        struct mmsghdr hdrs[BATCH_MAX];
+        struct iovec iovs[BATCH_MAX][2];
+        unsigned int prios[BATCH_MAX];
+        memset(hdrs, 0, sizeof(hdrs[0]) * chunk);
+        for (int i = 0; i < chunk; i++) {
+            const TransportMsg *m = &msgs[sent + i];
+            if (m->len > ep->msg_size) {
+                errno = EMSGSIZE;
+                return sent > 0 ? sent : -1;
+            }
+            prios[i] = m->prio;
+            unix_iov(iovs[i], &prios[i], m->buf, m->len);
+            hdrs[i].msg_hdr.msg_iov = iovs[i];
+            hdrs[i].msg_hdr.msg_iovlen = 2;
+        }
+        int n = sendmmsg(ep->fd, hdrs, chunk, 0);
+        if (n == -1) {
+            return sent > 0 ? sent : -1;
+        }
+        sent += n;
+        if (n < chunk) {
+            break;
+        }
+    }
+    return sent;
+}
+
+static int unix_backend_receive_batch(Endpoint *ep, TransportMsg *msgs, int count) {
+    int chunk = count < BATCH_MAX ? count : BATCH_MAX;
+    struct mmsghdr hdrs[BATCH_MAX];
+    struct iovec iovs[BATCH_MAX][2];
+    memset(hdrs, 0, sizeof(hdrs[0]) * chunk);
+    for (int i = 0; i < chunk; i++) {
+        unix_iov(iovs[i], &msgs[i].prio, msgs[i].buf, msgs[i].len);
+        hdrs[i].msg_hdr.msg_iov = iovs[i];
+        hdrs[i].msg_hdr.msg_iovlen = 2;
+    }
+    int n = recvmmsg(ep->fd, hdrs, chunk, MSG_WAITFORONE, NULL);
+    if (n == -1) {
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        if ((hdrs[i].msg_hdr.msg_flags & MSG_TRUNC) || hdrs[i].msg_len < sizeof(unsigned int)) {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        msgs[i].len = hdrs[i].msg_len - sizeof(unsigned int);
+    }
+    return n;
+}
+
+// ---- pierścień w pamięci dzielonej ----
+
+static void bell_path(const char *name, char *path) {
+    snprintf(path, BELL_PATH_SIZE, "/tmp/sop_bell%s", name);
+    for (char *p = path + strlen("/tmp/"); *p; p++) {
+        if (*p == '/') {
+            *p = '_';
+        }
+    }
+}
+
+static int ring_lock(Ring *r) {
+    int rc = pthread_mutex_lock(&r->lock);
+    if (rc == EOWNERDEAD) {
+        // Poprzedni właściciel zginął w trakcie operacji; liczniki są
+        // zmieniane na samym końcu, więc stan jest spójny
+        pthread_mutex_consistent(&r->lock);
+        rc = 0;
+    }
+    return rc;
+}
+
+static void ring_wait(Ring *r, pthread_cond_t *cond) {
+    if (pthread_cond_wait(cond, &r->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&r->lock);
+    }
+}
+
+static void ring_init(Ring *r, unsigned int slots, size_t msg_size) {
+    pthread_mutexattr_t ma;
+    pthread_mutexattr_init(&ma);
+    pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&ma, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&r->lock, &ma);
+    pthread_mutexattr_destroy(&ma);
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&r->not_empty, &ca);
+    pthread_cond_init(&r->not_full, &ca);
+    pthread_condattr_destroy(&ca);
+
+    r->head = r->tail = 0;
+    r->slots = slots;
+    r->msg_size = msg_size;
+    r->stride = (unsigned int)((sizeof(RingSlot) + msg_size + 7) & ~(size_t)7);
+    r->has_bell = 0;
+    __atomic_store_n(&r->magic, RING_MAGIC, __ATOMIC_RELEASE);
+}
+
+static int shm_backend_open(Endpoint *ep, long max_msgs) {
+    int created = 0;
+    int fd = -1;
+    if (ep->flags & EP_CREATE) {
+        fd = shm_open(ep->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd != -1) {
+            created = 1;
+        } else if (errno != EEXIST) {
+            return -1;
+        }
+    }
+    if (fd == -1 && (fd = shm_open(ep->name, O_RDWR, 0)) == -1) {
+        return -1;
+    }
+
+    size_t stride = (sizeof(RingSlot) + ep->msg_size + 7) & ~(size_t)7;
+    size_t len = sizeof(Ring) + (size_t)max_msgs * stride;
+    if (created && ftruncate(fd, len) == -1) {
+        goto fail;
+    }
+    if (!created) {
+        // Twórca mógł jeszcze nie ustawić rozmiaru
+        struct stat st;
+        while (1) {
+            if (fstat(fd, &st) == -1) {
+                goto fail;
+            }
+            if ((size_t)st.st_size >= sizeof(Ring)) {
+                break;
+            }
+            sched_yield();
+        }
+        len = st.st_size;
+    }
+    Ring *r = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (r == MAP_FAILED) {
+        goto fail;
+    }
+    close(fd);
+
+    if (created) {
+        ring_init(r, (unsigned int)max_msgs, ep->msg_size);
+    } else {
+        while (__atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) != RING_MAGIC) {
+            sched_yield();
+        }
+        ep->msg_size = r->msg_size;
+    }
+    ep->ring = r;
+    ep->ring_len = len;
+    return 0;
+
+fail:;
+    int saved = errno;
+    close(fd);
+    if (created) {
+        shm_unlink(ep->name);
+    }
+    errno = saved;
+    return -1;
+}
+
+static void ring_ring_bell(Endpoint *ep) {
+    if (!ep->ring->has_bell) {
+        return;
+    }
+    if (ep->fd == -1) {
+        // O_RDWR, żeby zapis nigdy nie dostał SIGPIPE, gdy odbiorca zniknie
+        char path[BELL_PATH_SIZE];
+        bell_path(ep->name, path);
+        ep->fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (ep->fd == -1) {
+            return;
+        }
+    }
+    char c = 0;
+    write(ep->fd, &c, 1); // pełne FIFO też oznacza "są wiadomości"
+}
+
+static void ring_drain_bell(Endpoint *ep) {
+    char junk[64];
+    if (ep->fd != -1) {
+        while (read(ep->fd, junk, sizeof(junk)) > 0) {
+        }
+    }
+}
+
+static int shm_backend_send_batch(Endpoint *ep, const TransportMsg *msgs, int count) {
+    Ring *r = ep->ring;
+    int sent = 0;
+    if (ring_lock(r) != 0) {
+        return -1;
+    }
+    while (sent < count) {
+        const TransportMsg *m = &msgs[sent];
+        if (m->len > r->msg_size) {
+            errno = EMSGSIZE;
+            break;
+        }
+        if (r->tail - r->head == r->slots) {
+            if (ep->flags & EP_NONBLOCK) {
+                errno = EAGAIN;
+                break;
+            }
+            ring_wait(r, &r->not_full);
+            continue;
+        }
+        RingSlot *slot = (RingSlot *)(r->data + (r->tail % r->slots) * r->stride);
+        slot->len = (unsigned int)m->len;
+        slot->prio = m->prio;
+        memcpy(slot->data, m->buf, m->len);
+        if (r->tail++ == r->head) {
+            ring_ring_bell(ep);
+        }
+        pthread_cond_signal(&r->not_empty);
+        sent++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return sent > 0 ? sent : -1;
+}
+
+static int shm_backend_receive_batch(Endpoint *ep, TransportMsg *msgs, int count) {
+    Ring *r = ep->ring;
+    int received = 0;
+    if (ring_lock(r) != 0) {
+        return -1;
+    }
+    while (r->tail == r->head) {
+        if (ep->flags & EP_NONBLOCK) {
+            ring_drain_bell(ep);
+            pthread_mutex_unlock(&r->lock);
+            errno = EAGAIN;
+            return -1;
+        }
+        ring_wait(r, &r->not_empty);
+    }
+    while (received < count && r->tail != r->head) {
+        RingSlot *slot = (RingSlot *)(r->data + (r->head % r->slots) * r->stride);
+        if (slot->len > msgs[received].len) {
+            errno = EMSGSIZE;
+            break;
+        }
+        memcpy(msgs[received].buf, slot->data, slot->len);
+        msgs[received].len = slot->len;
+        msgs[received].prio = slot->prio;
+        r->head++;
+        pthread_cond_signal(&r->not_full);
+        received++;
+    }
+    if (r->tail == r->head) {
+        ring_drain_bell(ep);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return received > 0 ? received : -1;
+}
+
+static int shm_backend_fd(Endpoint *ep) {
+    Ring *r = ep->ring;
+    if (ep->fd != -1) {
+        return ep->fd;
+    }
+    char path[BELL_PATH_SIZE];
+    bell_path(ep->name, path);
+    if (mkfifo(path, 0600) == -1 && errno != EEXIST) {
+        return -1;
+    }
+    if ((ep->fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC)) == -1) {
+        return -1;
+    }
+    if (ring_lock(r) != 0) {
+        return -1;
+    }
+    r->has_bell = 1;
+    if (r->tail != r->head) {
+        ring_ring_bell(ep);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return ep->fd;
+}
+
+// ---- wspólne ----
+
+Endpoint *endpoint_open_kind(TransportKind kind, const char *name, int flags, size_t msg_size, long max_msgs) {
+    Endpoint *ep = calloc(1, sizeof(Endpoint));
+    if (ep == NULL) {
+        return NULL;
+    }
+    ep->kind = kind;
+    ep->flags = flags;
+    ep->msg_size = msg_size;
+    ep->fd = -1;
+    snprintf(ep->name, ENDPOINT_NAME_SIZE, "%s", name);
+
+    int rc;
+    switch (kind) {
+    case TRANSPORT_UNIX:
+        rc = unix_backend_open(ep, max_msgs);
+        break;
+    case TRANSPORT_SHM:
+        rc = shm_backend_open(ep, max_msgs);
+        break;
+    default:
+        rc = mq_backend_open(ep, max_msgs);
+        break;
+    }
+    if (rc == -1) {
+        int saved = errno;
+        free(ep);
+        errno = saved;
+        return NULL;
+    }
+    return ep;
+}
+
+Endpoint *endpoint_open(const char *name, int flags, size_t msg_size, long max_msgs) {
+    return endpoint_open_kind(transport_default(), name, flags, msg_size, max_msgs);
+}
+
+void endpoint_close(Endpoint *ep) {
+    if (ep == NULL) {
+        return;
+    }
+    if (ep->fd != -1) {
+        close(ep->fd);
+    }
+    if (ep->ring != NULL) {
+        munmap(ep->ring, ep->ring_len);
+    }
+    free(ep);
+}
+
+int endpoint_unlink(const char *name) {
+    switch (transport_default()) {
+    case TRANSPORT_UNIX:
+        return 0; // adres abstrakcyjny znika razem z gniazdem
+    case TRANSPORT_SHM: {
+        char path[BELL_PATH_SIZE];
+        bell_path(name, path);
+        unlink(path);
+        return shm_unlink(name);
+    }
+    default:
+        return mq_unlink(name);
+    }
+}
+
+int endpoint_handover_fd(Endpoint *ep) {
+    if (ep->kind == TRANSPORT_SHM) {
+        return -1; // pierścień trwa w /dev/shm
+    }
+    if (fcntl(ep->fd, F_SETFD, fcntl(ep->fd, F_GETFD) & ~FD_CLOEXEC) == -1) {
+        return -1;
+    }
+    return ep->fd;
+}
+
+Endpoint *endpoint_adopt(int fd, const char *name, int flags, size_t msg_size, long max_msgs) {
+    if (fd == -1) {
+        return endpoint_open(name, flags, msg_size, max_msgs);
+    }
+    // Jak każdy inny punkt końcowy - do następnego endpoint_handover_fd
+    if (fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC) == -1) {
+        return NULL;
+    }
+    Endpoint *ep = calloc(1, sizeof(Endpoint));
+    if (ep == NULL) {
+        return NULL;
+    }
+    ep->kind = transport_default();
+    ep->flags = flags;
+    ep->msg_size = msg_size;
+    ep->fd = fd;
+    snprintf(ep->name, ENDPOINT_NAME_SIZE, "%s", name);
+    return ep;
+}
+
+int endpoint_send_batch(Endpoint *ep, const TransportMsg *msgs, int count) {
+    switch (ep->kind) {
+    case TRANSPORT_UNIX:
+        return unix_backend_send_batch(ep, msgs, count);
+    case TRANSPORT_SHM:
+        return shm_backend_send_batch(ep, msgs, count);
+    default:
+        for (int i = 0; i < count; i++) {
+            if (mq_send(ep->fd, msgs[i].buf, msgs[i].len, msgs[i].prio) == -1) {
+                return i > 0 ? i : -1;
+            }
+        }
+        return count;
+    }
+}
+
+int endpoint_receive_batch(Endpoint *ep, TransportMsg *msgs, int count) {
+    switch (ep->kind) {
+    case TRANSPORT_UNIX:
+        return unix_backend_receive_batch(ep, msgs, count);
+    case TRANSPORT_SHM:
+        return shm_backend_receive_batch(ep, msgs, count);
+    default:
+        return mq_backend_receive_batch(ep, msgs, count);
+    }
+}
+
+int endpoint_send(Endpoint *ep, const void *buf, size_t len, unsigned int prio) {
+    TransportMsg msg = {(void *)buf, len, prio};
+    return endpoint_send_batch(ep, &msg, 1) == 1 ? 0 : -1;
+}
+
+ssize_t endpoint_receive(Endpoint *ep, void *buf, size_t len, unsigned int *prio) {
+    TransportMsg msg = {buf, len, 0};
+    if (endpoint_receive_batch(ep, &msg, 1) != 1) {
+        return -1;
+    }
+    if (prio != NULL) {
+        *prio = msg.prio;
+    }
+    return (ssize_t)msg.len;
+}
+
+int endpoint_fd(Endpoint *ep) {
+    if (ep->kind == TRANSPORT_SHM) {
+        return shm_backend_fd(ep);
+    }
+    return ep->fd;
+}
+
+static void *notify_thread(void *arg) {
+    NotifyArgs *args = arg;
+    struct pollfd pfd = {args->fd, POLLIN, 0};
+    while (poll(&pfd, 1, -1) == -1 && errno == EINTR) {
+    }
+    args->fn(args->value);
+    free(args);
+    return NULL;
+}
+
+int endpoint_notify(Endpoint *ep, void (*fn)(union sigval), union sigval value) {
+    int fd = endpoint_fd(ep);
+    if (fd == -1) {
+        return -1;
+    }
+    NotifyArgs *args = malloc(sizeof(NotifyArgs));
+    if (args == NULL) {
+        return -1;
+    }
+    args->fd = fd;
+    args->fn = fn;
+    args->value = value;
+
+    pthread_attr_t attr;
+    pthread_t thread;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(&thread, &attr, notify_thread, args);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        free(args);
+        errno = rc;
+        return -1;
+    }
+    return 0;
+}
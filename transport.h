@@ -0,0 +1,78 @@
+// transport.h
+// Wspólny interfejs do przesyłania wiadomości między procesami.
+// Backend wybierany w czasie działania zmienną środowiskową SOP_TRANSPORT:
+//   mq   - kolejki POSIX (domyślnie), kolejność według priorytetu
+//   unix - gniazda AF_UNIX SOCK_DGRAM w abstrakcyjnej przestrzeni nazw
+//   shm  - pierścień w pamięci dzielonej (shm_open)
+// W backendach unix i shm priorytet jest przenoszony razem z wiadomością,
+// ale kolejność jest FIFO.
+//
+// Funkcje zwracają -1 i ustawiają errno tak jak mq_send/mq_receive,
+// w tym EAGAIN dla pustej/pełnej kolejki otwartej z EP_NONBLOCK.
+//
+// Kompilacja: gcc program.c transport.c -lrt -lpthread
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#define EP_READ 0x1
+#define EP_WRITE 0x2
+#define EP_CREATE 0x4
+#define EP_NONBLOCK 0x8
+
+typedef enum {
+    TRANSPORT_MQ,
+    TRANSPORT_UNIX,
+    TRANSPORT_SHM,
+} TransportKind;
+
+typedef struct Endpoint Endpoint;
+
+// Jedna wiadomość w operacjach wsadowych. Przy odbiorze len to rozmiar
+// bufora na wejściu i długość wiadomości na wyjściu.
+typedef struct {
+    void *buf;
+    size_t len;
+    unsigned int prio;
+} TransportMsg;
+
+TransportKind transport_default(void);
+const char *transport_name(TransportKind kind);
+
+// Otwiera punkt końcowy o nazwie w stylu mq ("/chat_x"). Tak jak mq_open z
+// O_CREAT otwiera istniejący, jeśli już jest. Deskryptor przeżywa fork().
+Endpoint *endpoint_open(const char *name, int flags, size_t msg_size, long max_msgs);
+Endpoint *endpoint_open_kind(TransportKind kind, const char *name, int flags, size_t msg_size, long max_msgs);
+void endpoint_close(Endpoint *ep);
+int endpoint_unlink(const char *name);
+
+// Przekazanie punktu końcowego nowemu obrazowi procesu przez exec().
+// Wszystkie deskryptory punktów końcowych mają FD_CLOEXEC; endpoint_handover_fd
+// zdejmuje je tylko z przekazywanego i zwraca deskryptor, który przeżyje exec, albo -1,
+// gdy backend (shm) wystarczy otworzyć ponownie po nazwie. endpoint_adopt
+// z fd == -1 robi po prostu endpoint_open.
+int endpoint_handover_fd(Endpoint *ep);
+Endpoint *endpoint_adopt(int fd, const char *name, int flags, size_t msg_size, long max_msgs);
+
+int endpoint_send(Endpoint *ep, const void *buf, size_t len, unsigned int prio);
+ssize_t endpoint_receive(Endpoint *ep, void *buf, size_t len, unsigned int *prio);
+
+// Wysyła count wiadomości, zwraca liczbę wysłanych (mniej tylko przy EAGAIN).
+int endpoint_send_batch(Endpoint *ep, const TransportMsg *msgs, int count);
+// Czeka (bez EP_NONBLOCK) na pierwszą wiadomość, potem zabiera bez czekania
+// to, co już jest, maksymalnie count. Zwraca liczbę odebranych.
+int endpoint_receive_batch(Endpoint *ep, TransportMsg *msgs, int count);
+
+// Deskryptor gotowy do poll()/select() (POLLIN, gdy są wiadomości).
+int endpoint_fd(Endpoint *ep);
+
+// Jednorazowe powiadomienie w stylu mq_notify z SIGEV_THREAD: fn zostanie
+// wywołana w osobnym wątku, gdy w kolejce będzie wiadomość - od razu, jeśli
+// już jakaś czeka. Dlatego rejestrować należy po opróżnieniu kolejki.
+int endpoint_notify(Endpoint *ep, void (*fn)(union sigval), union sigval value);
+
+#endif
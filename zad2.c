@@ -1,25 +1,71 @@
+// gcc zad2.c transport.c -lrt -lpthread
 #include <stdio.h>
 #include <stdlib.h>
-#include <fcntl.h>
-#include <mqueue.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <poll.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include <time.h>
 
+#include "transport.h"
+
 #define MAX_WORKERS 20
+#define TASKS_PER_WORKER 5
 #define TASK_QUEUE_PREFIX "/task_queue_"
 #define RESULT_QUEUE_PREFIX "/result_queue_"
-#define MSG_SIZE 64
 #define MAX_MSG 10
 
+// Klasy priorytetu; wyższa klasa zawsze pierwsza, w klasie najpierw
+// najwcześniejszy termin (EDF). Klasa jest też priorytetem w kolejce zadań.
+#define TASK_CLASSES 3
+#define CLASS_LOW 0
+#define CLASS_NORMAL 1
+#define CLASS_HIGH 2
+
+// Zadanie z id == TASK_STOP kończy pracownika
+#define TASK_STOP -1
+
+#define RESULT_DONE 0
+#define RESULT_EXPIRED 1 // termin minął, zanim pracownik zaczął
+
 typedef struct {
+    int id;
+    int task_class;
+    double deadline; // ms CLOCK_MONOTONIC, 0 - bez terminu
     double num1;
     double num2;
 } Task;
 
+typedef struct {
+    int id;
+    int task_class;
+    int status;
+    double deadline;
+    double finished;
+    double value;
+} Result;
+
+typedef struct {
+    int submitted;
+    int on_time;
+    int late;
+    int shed;    // wyrzucone przez serwer przed wysłaniem
+    int expired; // przeterminowane w kolejce, wyrzucone przez pracownika
+    int dropped; // niewysłane w chwili Ctrl+C
+} ClassStats;
+
+// Kopiec zadań czekających na wolnego pracownika
+typedef struct {
+    Task *tasks;
+    int count;
+} TaskHeap;
+
+static const char *class_names[TASK_CLASSES] = {"low", "normal", "high"};
+// Czas na wykonanie zadania danej klasy w ms, 0 - bez terminu
+static const int class_budget[TASK_CLASSES] = {0, 6000, 3000};
+
 volatile sig_atomic_t stop_signal = 0;
 
 void handle_sigint(int sig) {
@@ -31,117 +77,838 @@ double random_double(double min, double max) {
     return min + ((double)rand() / RAND_MAX) * (max - min);
 }
 
-// Funkcja procesu pracownika
-void worker_process(int worker_id, pid_t server_pid) {
-    char task_queue_name[32], result_queue_name[32];
-    sprintf(task_queue_name, "%s%d", TASK_QUEUE_PREFIX, server_pid);
-    sprintf(result_queue_name, "%s%d_%d", RESULT_QUEUE_PREFIX, server_pid, worker_id);
+double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
 
-    // Otwórz kolejkę zadań i utwórz własną kolejkę wyników
-    mqd_t task_queue = mq_open(task_queue_name, O_RDONLY);
-    if (task_queue == (mqd_t)-1) {
-        perror("mq_open (task_queue)");
-        exit(EXIT_FAILURE);
+// Czy zadanie a ma pierwszeństwo przed b
+int task_before(const Task *a, const Task *b) {
+    if (a->task_class != b->task_class) {
+        return a->task_class > b->task_class;
+    }
+    if (a->deadline != b->deadline) {
+        if (a->deadline == 0 || b->deadline == 0) {
+            return b->deadline == 0;
+        }
+        return a->deadline < b->deadline;
+    }
+    return a->id < b->id;
+}
+
+void heap_push(TaskHeap *heap, const Task *task) {
+    int i = heap->count++;
+    while (i > 0 && task_before(task, &heap->tasks[(i - 1) / 2])) {
+        heap->tasks[i] = heap->tasks[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap->tasks[i] = *task;
+}
+
+Task heap_pop(TaskHeap *heap) {
+    Task top = heap->tasks[0];
+    Task last = heap->tasks[--heap->count];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= heap->count) {
+            break;
+        }
+        if (child + 1 < heap->count && task_before(&heap->tasks[child + 1], &heap->tasks[child])) {
+            child++;
+        }
+        if (!task_before(&heap->tasks[child], &last)) {
+            break;
+        }
+        heap->tasks[i] = heap->tasks[child];
+        i = child;
     }
+    heap->tasks[i] = last;
+    return top;
+}
 
-    struct mq_attr attr = {0, MAX_MSG, MSG_SIZE, 0};
-    mqd_t result_queue = mq_open(result_queue_name, O_WRONLY | O_CREAT, 0644, &attr);
-    if (result_queue == (mqd_t)-1) {
-        perror("mq_open (result_queue)");
+// Funkcja procesu pracownika. Kolejkę zadań dziedziczy po serwerze, dzięki
+// czemu wszyscy pracownicy czytają z niej niezależnie od wybranego transportu.
+void worker_process(pid_t server_pid, Endpoint *task_queue, Endpoint *server_result_queue) {
+    char result_queue_name[32];
+    sprintf(result_queue_name, "%s%d", RESULT_QUEUE_PREFIX, server_pid);
+
+    // Własny, blokujący deskryptor kolejki wyników
+    endpoint_close(server_result_queue);
+    Endpoint *result_queue = endpoint_open(result_queue_name, EP_WRITE, sizeof(Result), MAX_MSG);
+    if (result_queue == NULL) {
+        perror("endpoint_open (result_queue)");
         exit(EXIT_FAILURE);
     }
 
     printf("[%d] Worker ready!\n", getpid());
 
-    for (int i = 0; i < 5; i++) {
+    while (1) {
         Task task;
-        if (mq_receive(task_queue, (char*)&task, sizeof(Task), NULL) == -1) {
-            perror("mq_receive");
+        if (endpoint_receive(task_queue, &task, sizeof(Task), NULL) == -1) {
+            perror("endpoint_receive");
             continue;
         }
-        printf("[%d] Received task [%.2f, %.2f]\n", getpid(), task.num1, task.num2);
+        if (task.id == TASK_STOP) {
+            break;
+        }
 
-        // Symulacja pracy
-        usleep((rand() % 1500 + 500) * 1000);
+        Result result = {task.id, task.task_class, RESULT_DONE, task.deadline, 0, 0};
+        if (task.deadline != 0 && now_ms() >= task.deadline) {
+            // Wynik i tak byłby spóźniony - szkoda na niego czasu
+            printf("[%d] Task %d expired in queue\n", getpid(), task.id);
+            result.status = RESULT_EXPIRED;
+        } else {
+            printf("[%d] Received task %d [%.2f, %.2f]\n", getpid(), task.id, task.num1, task.num2);
 
-        double result = task.num1 + task.num2;
-        printf("[%d] Result [%.2f]\n", getpid(), result);
+            // Symulacja pracy
+            usleep((rand() % 1500 + 500) * 1000);
 
-        if (mq_send(result_queue, (char*)&result, sizeof(double), 0) == -1) {
-            perror("mq_send");
-        } else {
-            printf("[%d] Result sent [%.2f]\n", getpid(), result);
+            result.value = task.num1 + task.num2;
+            printf("[%d] Result [%.2f]\n", getpid(), result.value);
+        }
+        result.finished = now_ms();
+
+        if (endpoint_send(result_queue, &result, sizeof(Result), 0) == -1) {
+            perror("endpoint_send");
+        } else if (result.status == RESULT_DONE) {
+            printf("[%d] Result sent [%.2f]\n", getpid(), result.value);
         }
     }
 
     printf("[%d] Exits\n", getpid());
 
-    mq_close(task_queue);
-    mq_close(result_queue);
-    mq_unlink(result_queue_name);
+    endpoint_close(task_queue);
+    endpoint_close(result_queue);
     exit(0);
 }
 
-// Funkcja procesu serwera
+Task new_task(int id) {
+    Task task = {id, rand() % TASK_CLASSES, 0, random_double(0.0, 100.0), random_double(0.0, 100.0)};
+    int budget = class_budget[task.task_class];
+    if (budget > 0) {
+        task.deadline = now_ms() + random_double(0.5, 1.5) * budget;
+    }
+    return task;
+}
+
+void collect_results(Endpoint *result_queue, ClassStats *stats, int *in_flight) {
+    Result result;
+    while (endpoint_receive(result_queue, &result, sizeof(Result), NULL) != -1) {
+        (*in_flight)--;
+        ClassStats *s = &stats[result.task_class];
+        if (result.status == RESULT_EXPIRED) {
+            s->expired++;
+        } else if (result.deadline != 0 && result.finished > result.deadline) {
+            printf("Task %d (%s) finished %.0f ms late\n", result.id, class_names[result.task_class],
+                   result.finished - result.deadline);
+            s->late++;
+        } else {
+            s->on_time++;
+        }
+    }
+    if (errno != EAGAIN) {
+        perror("endpoint_receive (result_queue)");
+    }
+}
+
+void print_stats(const ClassStats *stats) {
+    for (int c = TASK_CLASSES - 1; c >= 0; c--) {
+        const ClassStats *s = &stats[c];
+        int missed = s->late + s->shed + s->expired;
+        int judged = s->submitted - s->dropped; // porzucone nie miały szansy zdążyć
+        printf("Class %-6s: %d tasks, %d on time, %d late, %d shed, %d expired in queue, %d dropped", class_names[c],
+               s->submitted, s->on_time, s->late, s->shed, s->expired, s->dropped);
+        if (class_budget[c] > 0 && judged > 0) {
+            printf(", %.1f%% deadlines missed", 100.0 * missed / judged);
+        }
+        printf("\n");
+    }
+}
+
+// Funkcja procesu serwera. Zadania czekają u serwera w kopcu, a do kolejki
+// trafia ich najwyżej tyle, ilu jest pracowników - dzięki temu o kolejności
+// decyduje serwer, a przeterminowane zadania odpadają przed wysłaniem.
 void server_process(int num_workers, int t1, int t2) {
-    char task_queue_name[32];
-    sprintf(task_queue_name, "%s%d", TASK_QUEUE_PREFIX, getpid());
+    char task_queue_name[32], result_queue_name[32];
+    pid_t server_pid = getpid();
+    sprintf(task_queue_name, "%s%d", TASK_QUEUE_PREFIX, server_pid);
+    sprintf(result_queue_name, "%s%d", RESULT_QUEUE_PREFIX, server_pid);
 
-    struct mq_attr attr = {0, MAX_MSG, MSG_SIZE, 0};
-    mqd_t task_queue = mq_open(task_queue_name, O_WRONLY | O_CREAT, 0644, &attr);
-    if (task_queue == (mqd_t)-1) {
-        perror("mq_open (task_queue)");
+    Endpoint *task_queue = endpoint_open(task_queue_name, EP_READ | EP_WRITE | EP_CREATE, sizeof(Task), MAX_MSG);
+    if (task_queue == NULL) {
+        perror("endpoint_open (task_queue)");
+        exit(EXIT_FAILURE);
+    }
+    Endpoint *result_queue =
+        endpoint_open(result_queue_name, EP_READ | EP_CREATE | EP_NONBLOCK, sizeof(Result), MAX_MSG);
+    if (result_queue == NULL) {
+        perror("endpoint_open (result_queue)");
         exit(EXIT_FAILURE);
     }
 
-    signal(SIGINT, handle_sigint);
+    // Bez SA_RESTART: Ctrl+C przerywa poll()
+    struct sigaction sa = {};
+    sa.sa_handler = handle_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
 
     printf("Server is starting...\n");
+    fflush(stdout);
 
     pid_t workers[num_workers];
     for (int i = 0; i < num_workers; i++) {
         if ((workers[i] = fork()) == 0) {
-            worker_process(i, getpid());
+            worker_process(server_pid, task_queue, result_queue);
         }
     }
 
     srand(time(NULL));
 
-    for (int i = 0; i < num_workers * 5; i++) {
-        if (stop_signal) break;
+    int total = num_workers * TASKS_PER_WORKER;
+    TaskHeap pending = {malloc(total * sizeof(Task)), 0};
+    if (pending.tasks == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    ClassStats stats[TASK_CLASSES] = {};
+    int generated = 0, in_flight = 0;
+    double next_arrival = now_ms() + rand() % (t2 - t1) + t1;
+
+    while ((!stop_signal && generated < total) || pending.count > 0 || in_flight > 0) {
+        double now = now_ms();
+        if (stop_signal) {
+            // Niewysłane porzucamy, czekamy tylko na rozpoczęte
+            for (int i = 0; i < pending.count; i++) {
+                stats[pending.tasks[i].task_class].dropped++;
+            }
+            pending.count = 0;
+        } else if (generated < total && now >= next_arrival) {
+            Task task = new_task(generated++);
+            heap_push(&pending, &task);
+            stats[task.task_class].submitted++;
+            printf("New task %d (%s): [%.2f, %.2f]", task.id, class_names[task.task_class], task.num1, task.num2);
+            if (task.deadline != 0) {
+                printf(", deadline in %.0f ms", task.deadline - now);
+            }
+            printf("\n");
+            next_arrival = now + rand() % (t2 - t1) + t1;
+        }
 
-        usleep((rand() % (t2 - t1) + t1) * 1000);
+        // Wolni pracownicy dostają najpilniejsze zadania, które jeszcze mają sens
+        while (in_flight < num_workers && pending.count > 0) {
+            Task task = heap_pop(&pending);
+            if (task.deadline != 0 && task.deadline <= now) {
+                printf("Task %d (%s) shed, deadline passed %.0f ms ago\n", task.id, class_names[task.task_class],
+                       now - task.deadline);
+                stats[task.task_class].shed++;
+                continue;
+            }
+            if (endpoint_send(task_queue, &task, sizeof(Task), task.task_class) == -1) {
+                perror("endpoint_send (task_queue)");
+                break;
+            }
+            in_flight++;
+        }
 
-        Task task = {random_double(0.0, 100.0), random_double(0.0, 100.0)};
-        if (mq_send(task_queue, (char*)&task, sizeof(Task), 0) == -1) {
-            printf("Queue is full!\n");
-        } else {
-            printf("New task queued: [%.2f, %.2f]\n", task.num1, task.num2);
+        int timeout = -1;
+        if (!stop_signal && generated < total) {
+            timeout = next_arrival > now ? (int)(next_arrival - now) + 1 : 0;
+        }
+        struct pollfd pfd = {endpoint_fd(result_queue), POLLIN, 0};
+        if (poll(&pfd, 1, timeout) == -1 && errno != EINTR) {
+            perror("poll");
+            break;
         }
+        collect_results(result_queue, stats, &in_flight);
     }
 
-    // Oczekiwanie na zakończenie pracowników
+    // Wszystkie zadania rozliczone - pracownicy mogą kończyć
+    Task stop = {TASK_STOP};
+    for (int i = 0; i < num_workers; i++) {
+        endpoint_send(task_queue, &stop, sizeof(Task), 0);
+    }
     for (int i = 0; i < num_workers; i++) {
         waitpid(workers[i], NULL, 0);
     }
 
     printf("All child processes have finished.\n");
+    print_stats(stats);
 
-    mq_close(task_queue);
-    mq_unlink(task_queue_name);
+    free(pending.tasks);
+    endpoint_close(result_queue);
+    endpoint_unlink(result_queue_name);
+    endpoint_close(task_queue);
+    endpoint_unlink(task_queue_name);
+}
+
+// ---- Tryb grafu zadań (-g) ----
+//
+// Plik grafu, jeden węzeł w wierszu ('#' zaczyna komentarz):
+//   <nazwa> <koszt_ms> <op> <arg1> <arg2>
+// op to + - * /, argument to liczba albo nazwa innego węzła - wtedy węzeł
+// czeka na jego wynik. Przykład:
+//   a 500 + 1 2
+//   b 800 * 3 4
+//   c 300 - a b
+//
+// Serwer rozmieszcza węzły na pracownikach z góry (list scheduling według
+// najdłuższej ścieżki do końca grafu) i wysyła każdemu jego węzły. Pracownik
+// liczy węzeł, gdy tylko ma wszystkie wejścia, a wynik wysyła wprost do
+// skrzynek pracowników z węzłami, które go potrzebują. Serwer dostaje tylko
+// raporty o zakończonych węzłach.
+#define DAG_MAX_NODES 64
+#define DAG_MAX_INPUTS 2
+#define DAG_MAX_CONSUMERS 8
+#define DAG_NAME_SIZE 16
+// Wysłane, a jeszcze nieprzyjęte przez pełne kolejki odbiorców
+#define DAG_OUTBOX_SIZE (DAG_MAX_NODES * (DAG_MAX_CONSUMERS + 1))
+
+#define DAG_NODE 0
+#define DAG_INPUT 1
+#define DAG_STOP 2
+
+// Dokąd trafia wynik węzła: wejście slot węzła node na pracowniku worker
+typedef struct {
+    int node;
+    int worker;
+    int slot;
+} DagEdge;
+
+// Wiadomość w skrzynce pracownika
+typedef struct {
+    int kind;
+    int node;
+    // DAG_INPUT
+    int slot;
+    double value;
+    // DAG_NODE
+    int cost_ms;
+    char op;
+    int needed; // maska wejść, które przyjdą od innych węzłów
+    double args[DAG_MAX_INPUTS];
+    int consumers;
+    DagEdge to[DAG_MAX_CONSUMERS];
+} DagMsg;
+
+typedef struct {
+    int node;
+    int worker;
+    double started;
+    double finished;
+    double value;
+} DagReport;
+
+typedef struct {
+    char name[DAG_NAME_SIZE];
+    int cost_ms;
+    char op;
+    double args[DAG_MAX_INPUTS];
+    int input[DAG_MAX_INPUTS]; // węzeł-źródło albo -1 dla stałej
+    int consumers;
+    DagEdge to[DAG_MAX_CONSUMERS];
+    double rank; // najdłuższa ścieżka od początku węzła do końca grafu
+    int worker;
+} DagNode;
+
+typedef struct {
+    Endpoint *queue;
+    size_t len;
+    union {
+        DagMsg msg;
+        DagReport report;
+    } data;
+} DagOutgoing;
+
+double dag_apply(char op, double a, double b) {
+    switch (op) {
+    case '+':
+        return a + b;
+    case '-':
+        return a - b;
+    case '*':
+        return a * b;
+    default:
+        return a / b;
+    }
+}
+
+int dag_find(DagNode *nodes, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(nodes[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Czy cały napis jest liczbą - w rozumieniu strtod, więc także inf, nan, 1e3
+int dag_number(const char *text, double *value) {
+    char *end;
+    *value = strtod(text, &end);
+    return end != text && *end == '\0';
+}
+
+// Wczytuje graf, sprawdza, czy nie ma cykli, i liczy rank węzłów.
+// Zwraca liczbę węzłów albo -1 z komunikatem na stderr.
+int dag_load(const char *path, DagNode *nodes) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror("fopen (graph)");
+        return -1;
+    }
+    // Argument będący liczbą trafia od razu do węzła, tu zostaje pusty
+    char line[256], args[DAG_MAX_NODES][DAG_MAX_INPUTS][DAG_NAME_SIZE];
+    int count = 0, line_no = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_no++;
+        line[strcspn(line, "#\n")] = 0;
+        char name[sizeof(line)], arg[DAG_MAX_INPUTS][sizeof(line)];
+        if (sscanf(line, "%255s", name) != 1) {
+            continue; // pusty wiersz
+        }
+        if (count == DAG_MAX_NODES) {
+            fprintf(stderr, "%s:%d: more than %d nodes\n", path, line_no, DAG_MAX_NODES);
+            goto fail;
+        }
+        DagNode *node = &nodes[count];
+        memset(node, 0, sizeof(DagNode));
+        char op[2];
+        double value;
+        if (sscanf(line, "%255s %d %1s %255s %255s", name, &node->cost_ms, op, arg[0], arg[1]) != 5 ||
+            node->cost_ms < 0 || strchr("+-*/", op[0]) == NULL) {
+            fprintf(stderr, "%s:%d: expected <name> <cost_ms> <+|-|*|/> <arg> <arg>\n", path, line_no);
+            goto fail;
+        }
+        if (strlen(name) >= DAG_NAME_SIZE) {
+            fprintf(stderr, "%s:%d: node name %s longer than %d characters\n", path, line_no, name, DAG_NAME_SIZE - 1);
+            goto fail;
+        }
+        if (dag_number(name, &value)) {
+            fprintf(stderr, "%s:%d: node name %s is a number\n", path, line_no, name);
+            goto fail;
+        }
+        strcpy(node->name, name);
+        for (int s = 0; s < DAG_MAX_INPUTS; s++) {
+            if (dag_number(arg[s], &node->args[s])) {
+                args[count][s][0] = '\0';
+            } else if (strlen(arg[s]) < DAG_NAME_SIZE) {
+                strcpy(args[count][s], arg[s]);
+            } else {
+                fprintf(stderr, "%s:%d: input %s is neither a number nor a node name\n", path, line_no, arg[s]);
+                goto fail;
+            }
+        }
+        if (dag_find(nodes, count, node->name) != -1) {
+            fprintf(stderr, "%s:%d: node %s defined twice\n", path, line_no, node->name);
+            goto fail;
+        }
+        node->op = op[0];
+        count++;
+    }
+    fclose(file);
+
+    // Argumenty: liczba albo nazwa węzła, także zdefiniowanego niżej
+    int waiting[DAG_MAX_NODES] = {};
+    for (int i = 0; i < count; i++) {
+        for (int s = 0; s < DAG_MAX_INPUTS; s++) {
+            nodes[i].input[s] = -1;
+            if (args[i][s][0] == '\0') {
+                continue;
+            }
+            int src = dag_find(nodes, count, args[i][s]);
+            if (src == -1) {
+                fprintf(stderr, "%s: node %s: unknown input %s\n", path, nodes[i].name, args[i][s]);
+                return -1;
+            }
+            if (nodes[src].consumers == DAG_MAX_CONSUMERS) {
+                fprintf(stderr, "%s: node %s feeds more than %d nodes\n", path, nodes[src].name, DAG_MAX_CONSUMERS);
+                return -1;
+            }
+            nodes[i].input[s] = src;
+            nodes[src].to[nodes[src].consumers++] = (DagEdge){i, -1, s};
+            waiting[i]++;
+        }
+    }
+
+    // Kolejność topologiczna (Kahn); czego nie da się ustawić, leży na cyklu
+    int order[DAG_MAX_NODES], ordered = 0;
+    for (int i = 0; i < count; i++) {
+        if (waiting[i] == 0) {
+            order[ordered++] = i;
+        }
+    }
+    for (int k = 0; k < ordered; k++) {
+        DagNode *node = &nodes[order[k]];
+        for (int c = 0; c < node->consumers; c++) {
+            if (--waiting[node->to[c].node] == 0) {
+                order[ordered++] = node->to[c].node;
+            }
+        }
+    }
+    if (ordered < count) {
+        fprintf(stderr, "%s: graph has a cycle\n", path);
+        return -1;
+    }
+    for (int k = count - 1; k >= 0; k--) {
+        DagNode *node = &nodes[order[k]];
+        double longest = 0;
+        for (int c = 0; c < node->consumers; c++) {
+            if (nodes[node->to[c].node].rank > longest) {
+                longest = nodes[node->to[c].node].rank;
+            }
+        }
+        node->rank = node->cost_ms + longest;
+    }
+    return count;
+
+fail:
+    fclose(file);
+    return -1;
+}
+
+// Rozmieszczenie: węzły w kolejności malejącego rank (rodzic zawsze przed
+// dzieckiem) trafiają do pracownika, u którego najwcześniej mogą ruszyć;
+// przy remisie do pracownika rodzica, żeby wynik nie musiał nigdzie jechać.
+// Zwraca przewidywany czas całości, order dostaje kolejność węzłów.
+double dag_place(DagNode *nodes, int count, int num_workers, int *order) {
+    double worker_free[MAX_WORKERS] = {}, finish[DAG_MAX_NODES];
+    int placed[DAG_MAX_NODES] = {};
+    double makespan = 0;
+
+    for (int k = 0; k < count; k++) {
+        // Najwyższy rank wśród węzłów, których rodzice już są rozmieszczeni
+        int best = -1;
+        for (int i = 0; i < count; i++) {
+            if (placed[i] || (nodes[i].input[0] != -1 && !placed[nodes[i].input[0]]) ||
+                (nodes[i].input[1] != -1 && !placed[nodes[i].input[1]])) {
+                continue;
+            }
+            if (best == -1 || nodes[i].rank > nodes[best].rank) {
+                best = i;
+            }
+        }
+        DagNode *node = &nodes[best];
+        double ready = 0;
+        for (int s = 0; s < DAG_MAX_INPUTS; s++) {
+            if (node->input[s] != -1 && finish[node->input[s]] > ready) {
+                ready = finish[node->input[s]];
+            }
+        }
+        int worker = -1;
+        double start = 0;
+        for (int w = 0; w < num_workers; w++) {
+            double s = worker_free[w] > ready ? worker_free[w] : ready;
+            int local = (node->input[0] != -1 && nodes[node->input[0]].worker == w) ||
+                        (node->input[1] != -1 && nodes[node->input[1]].worker == w);
+            if (worker == -1 || s < start || (s == start && local)) {
+                worker = w;
+                start = s;
+            }
+        }
+        node->worker = worker;
+        finish[best] = start + node->cost_ms;
+        worker_free[worker] = finish[best];
+        if (finish[best] > makespan) {
+            makespan = finish[best];
+        }
+        placed[best] = 1;
+        order[k] = best;
+    }
+
+    for (int i = 0; i < count; i++) {
+        for (int c = 0; c < nodes[i].consumers; c++) {
+            nodes[i].to[c].worker = nodes[nodes[i].to[c].node].worker;
+        }
+    }
+    return makespan;
+}
+
+// Kolejki są nieblokujące: pracownik czekający na pełną skrzynkę innego
+// pracownika nie może przestać opróżniać własnej, bo tamten może właśnie
+// czekać na niego. Niewysłane wiadomości czekają w kolejności w outbox.
+int dag_flush(DagOutgoing *outbox, int *head, int *count) {
+    while (*count > 0) {
+        DagOutgoing *out = &outbox[*head];
+        if (endpoint_send(out->queue, &out->data, out->len, 0) == -1) {
+            if (errno != EAGAIN) {
+                perror("endpoint_send (dag)");
+                exit(EXIT_FAILURE);
+            }
+            return -1;
+        }
+        *head = (*head + 1) % DAG_OUTBOX_SIZE;
+        (*count)--;
+    }
+    return 0;
+}
+
+void dag_worker_process(int worker_id, pid_t server_pid, Endpoint **inboxes, int num_workers,
+                        Endpoint *server_result_queue) {
+    char result_queue_name[32];
+    sprintf(result_queue_name, "%s%d", RESULT_QUEUE_PREFIX, server_pid);
+    endpoint_close(server_result_queue);
+    Endpoint *result_queue = endpoint_open(result_queue_name, EP_WRITE | EP_NONBLOCK, sizeof(DagReport), MAX_MSG);
+    if (result_queue == NULL) {
+        perror("endpoint_open (result_queue)");
+        exit(EXIT_FAILURE);
+    }
+    Endpoint *inbox = inboxes[worker_id];
+
+    // Węzły tego pracownika, indeksowane numerem węzła w grafie. Wejście może
+    // przyjść, zanim serwer przyśle definicję węzła.
+    static DagMsg defs[DAG_MAX_NODES];
+    static DagOutgoing outbox[DAG_OUTBOX_SIZE];
+    int defined[DAG_MAX_NODES] = {}, arrived[DAG_MAX_NODES] = {}, done[DAG_MAX_NODES] = {};
+    int seq[DAG_MAX_NODES], next_seq = 0;
+    double inputs[DAG_MAX_NODES][DAG_MAX_INPUTS];
+    int out_head = 0, out_count = 0;
+
+    printf("[%d] Worker %d ready!\n", getpid(), worker_id);
+
+    while (1) {
+        dag_flush(outbox, &out_head, &out_count);
+
+        DagMsg msg;
+        int stop = 0;
+        while (endpoint_receive(inbox, &msg, sizeof(DagMsg), NULL) != -1) {
+            if (msg.kind == DAG_STOP) {
+                stop = 1;
+            } else if (msg.kind == DAG_NODE) {
+                defs[msg.node] = msg;
+                defined[msg.node] = 1;
+                seq[msg.node] = next_seq++;
+            } else {
+                inputs[msg.node][msg.slot] = msg.value;
+                arrived[msg.node] |= 1 << msg.slot;
+            }
+        }
+        if (errno != EAGAIN && errno != EINTR) {
+            perror("endpoint_receive (inbox)");
+            exit(EXIT_FAILURE);
+        }
+        if (stop) {
+            break; // serwer ma już raporty ze wszystkich węzłów
+        }
+
+        // Gotowy węzeł, który przyszedł najwcześniej - serwer wysyła je od najdłuższej ścieżki
+        int ready = -1;
+        for (int i = 0; i < DAG_MAX_NODES; i++) {
+            if (defined[i] && !done[i] && (arrived[i] & defs[i].needed) == defs[i].needed &&
+                (ready == -1 || seq[i] < seq[ready])) {
+                ready = i;
+            }
+        }
+        if (ready == -1) {
+            struct pollfd pfd = {endpoint_fd(inbox), POLLIN, 0};
+            poll(&pfd, 1, out_count > 0 ? 1 : -1);
+            continue;
+        }
+
+        DagMsg *node = &defs[ready];
+        double args[DAG_MAX_INPUTS];
+        for (int s = 0; s < DAG_MAX_INPUTS; s++) {
+            args[s] = node->needed & (1 << s) ? inputs[ready][s] : node->args[s];
+        }
+        DagReport report = {ready, worker_id, now_ms(), 0, 0};
+        usleep(node->cost_ms * 1000); // Symulacja pracy
+        report.value = dag_apply(node->op, args[0], args[1]);
+        report.finished = now_ms();
+        done[ready] = 1;
+
+        for (int c = 0; c < node->consumers; c++) {
+            DagEdge *edge = &node->to[c];
+            if (edge->worker == worker_id) {
+                inputs[edge->node][edge->slot] = report.value;
+                arrived[edge->node] |= 1 << edge->slot;
+                continue;
+            }
+            DagOutgoing *out = &outbox[(out_head + out_count++) % DAG_OUTBOX_SIZE];
+            out->queue = inboxes[edge->worker];
+            out->len = sizeof(DagMsg);
+            memset(&out->data.msg, 0, sizeof(DagMsg));
+            out->data.msg.kind = DAG_INPUT;
+            out->data.msg.node = edge->node;
+            out->data.msg.slot = edge->slot;
+            out->data.msg.value = report.value;
+        }
+        // Raport na końcu: serwer kończy dopiero, gdy wyniki są już u odbiorców
+        DagOutgoing *out = &outbox[(out_head + out_count++) % DAG_OUTBOX_SIZE];
+        out->queue = result_queue;
+        out->len = sizeof(DagReport);
+        out->data.report = report;
+    }
+
+    printf("[%d] Exits\n", getpid());
+    for (int i = 0; i < num_workers; i++) {
+        endpoint_close(inboxes[i]);
+    }
+    endpoint_close(result_queue);
+    exit(0);
+}
+
+// Zwraca liczbę odebranych raportów
+int dag_collect(Endpoint *result_queue, DagReport *reports) {
+    DagReport report;
+    int received = 0;
+    while (endpoint_receive(result_queue, &report, sizeof(DagReport), NULL) != -1) {
+        reports[report.node] = report;
+        received++;
+    }
+    return received;
+}
+
+void dag_send(Endpoint *queue, const DagMsg *msg, Endpoint *result_queue, DagReport *reports, int *received) {
+    while (endpoint_send(queue, msg, sizeof(DagMsg), 0) == -1) {
+        if (errno != EAGAIN) {
+            perror("endpoint_send (inbox)");
+            exit(EXIT_FAILURE);
+        }
+        // Skrzynka pełna - w międzyczasie odbieramy raporty, żeby pracownicy nie stanęli
+        *received += dag_collect(result_queue, reports);
+        usleep(1000);
+    }
+}
+
+void dag_server_process(const char *graph_path, int num_workers) {
+    static DagNode nodes[DAG_MAX_NODES];
+    int count = dag_load(graph_path, nodes);
+    if (count <= 0) {
+        if (count == 0) {
+            fprintf(stderr, "%s: empty graph\n", graph_path);
+        }
+        exit(EXIT_FAILURE);
+    }
+    int order[DAG_MAX_NODES];
+    double planned = dag_place(nodes, count, num_workers, order);
+
+    char result_queue_name[32], inbox_names[MAX_WORKERS][32];
+    pid_t server_pid = getpid();
+    sprintf(result_queue_name, "%s%d", RESULT_QUEUE_PREFIX, server_pid);
+    Endpoint *result_queue =
+        endpoint_open(result_queue_name, EP_READ | EP_CREATE | EP_NONBLOCK, sizeof(DagReport), MAX_MSG);
+    if (result_queue == NULL) {
+        perror("endpoint_open (result_queue)");
+        exit(EXIT_FAILURE);
+    }
+    // Skrzynki pracowników; każdy pracownik pisze do każdej
+    Endpoint *inboxes[MAX_WORKERS];
+    for (int i = 0; i < num_workers; i++) {
+        sprintf(inbox_names[i], "%s%d_%d", TASK_QUEUE_PREFIX, server_pid, i);
+        inboxes[i] = endpoint_open(inbox_names[i], EP_READ | EP_WRITE | EP_CREATE | EP_NONBLOCK, sizeof(DagMsg), MAX_MSG);
+        if (inboxes[i] == NULL) {
+            perror("endpoint_open (inbox)");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct sigaction sa = {};
+    sa.sa_handler = handle_sigint;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+
+    printf("Server is starting, graph of %d nodes...\n", count);
+    fflush(stdout);
+
+    pid_t workers[num_workers];
+    for (int i = 0; i < num_workers; i++) {
+        if ((workers[i] = fork()) == 0) {
+            dag_worker_process(i, server_pid, inboxes, num_workers, result_queue);
+        }
+    }
+
+    double critical_path = 0, work = 0;
+    for (int i = 0; i < count; i++) {
+        critical_path = nodes[i].rank > critical_path ? nodes[i].rank : critical_path;
+        work += nodes[i].cost_ms;
+    }
+
+    double start = now_ms();
+    DagReport reports[DAG_MAX_NODES];
+    int received = 0;
+    for (int k = 0; k < count; k++) {
+        DagNode *node = &nodes[order[k]];
+        DagMsg msg = {DAG_NODE, order[k]};
+        msg.cost_ms = node->cost_ms;
+        msg.op = node->op;
+        for (int s = 0; s < DAG_MAX_INPUTS; s++) {
+            msg.args[s] = node->args[s];
+            if (node->input[s] != -1) {
+                msg.needed |= 1 << s;
+            }
+        }
+        msg.consumers = node->consumers;
+        memcpy(msg.to, node->to, sizeof(msg.to));
+        dag_send(inboxes[node->worker], &msg, result_queue, reports, &received);
+    }
+
+    while (received < count && !stop_signal) {
+        struct pollfd pfd = {endpoint_fd(result_queue), POLLIN, 0};
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        received += dag_collect(result_queue, reports);
+    }
+    double makespan = now_ms() - start;
+
+    DagMsg stop = {DAG_STOP};
+    for (int i = 0; i < num_workers; i++) {
+        dag_send(inboxes[i], &stop, result_queue, reports, &received);
+    }
+    for (int i = 0; i < num_workers; i++) {
+        waitpid(workers[i], NULL, 0);
+    }
+
+    printf("All child processes have finished.\n");
+    if (received == count) {
+        for (int k = 0; k < count; k++) {
+            DagReport *report = &reports[order[k]];
+            printf("Node %-8s on worker %d: %6.0f..%6.0f ms = %.2f\n", nodes[order[k]].name, report->worker,
+                   report->started - start, report->finished - start, report->value);
+        }
+        for (int i = 0; i < count; i++) {
+            if (nodes[i].consumers == 0) {
+                printf("Result %s = %.2f\n", nodes[i].name, reports[i].value);
+            }
+        }
+        printf("Makespan %.0f ms, critical path %.0f ms, planned %.0f ms, total work %.0f ms on %d workers\n",
+               makespan, critical_path, planned, work, num_workers);
+    } else {
+        printf("Interrupted, %d of %d nodes finished\n", received, count);
+    }
+
+    endpoint_close(result_queue);
+    endpoint_unlink(result_queue_name);
+    for (int i = 0; i < num_workers; i++) {
+        endpoint_close(inboxes[i]);
+        endpoint_unlink(inbox_names[i]);
+    }
 }
 
 int main(int argc, char *argv[]) {
     if (argc != 4) {
-        fprintf(stderr, "Usage: %s <num_workers> <T1> <T2>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <num_workers> <T1> <T2>\n       %s -g <graph_file> <num_workers>\n", argv[0],
+                argv[0]);
         exit(EXIT_FAILURE);
     }
 
+    if (strcmp(argv[1], "-g") == 0) {
+        int num_workers = atoi(argv[3]);
+        if (num_workers < 1 || num_workers > MAX_WORKERS) {
+            fprintf(stderr, "Invalid arguments. Constraints: 1 <= num_workers <= 20\n");
+            exit(EXIT_FAILURE);
+        }
+        dag_server_process(argv[2], num_workers);
+        return 0;
+    }
+
     int num_workers = atoi(argv[1]);
     int t1 = atoi(argv[2]);
     int t2 = atoi(argv[3]);
 
-    if (num_workers < 2 || num_workers > 20 || t1 < 100 || t2 > 5000 || t1 >= t2) {
+    if (num_workers < 2 || num_workers > MAX_WORKERS || t1 < 100 || t2 > 5000 || t1 >= t2) {
         fprintf(stderr, "Invalid arguments. Constraints: 2 <= num_workers <= 20, 100 <= T1 < T2 <= 5000\n");
         exit(EXIT_FAILURE);
     }